@@ -0,0 +1,39 @@
+#include <string.h>
+
+#include "bitboard.h"
+#include "dungeon.h"
+
+static inline void bitboard_set(bitrow_t *board, int32_t y, int32_t x,
+                                uint32_t v)
+{
+  board[y] = (board[y] & ~(BITROW_ONE << x)) | ((bitrow_t) !!v << x);
+}
+
+void bitboard_update(dungeon_t *d, pair_t pos)
+{
+  terrain_type_t t = mappair(pos);
+  uint32_t opaque = t < ter_floor && t != ter_wizard;
+
+  if (bitboard_test(d->opaque, pos[dim_y], pos[dim_x]) != opaque) {
+    d->opaque_generation++;
+  }
+  bitboard_set(d->passable, pos[dim_y], pos[dim_x], t >= ter_floor);
+  bitboard_set(d->opaque, pos[dim_y], pos[dim_x], opaque);
+  bitboard_set(d->immutable, pos[dim_y], pos[dim_x],
+               t == ter_wall_immutable);
+}
+
+void bitboard_build(dungeon_t *d)
+{
+  pair_t p;
+
+  memset(d->passable, 0, sizeof (d->passable));
+  memset(d->opaque, 0, sizeof (d->opaque));
+  memset(d->immutable, 0, sizeof (d->immutable));
+  for (p[dim_y] = 0; p[dim_y] < DUNGEON_Y; p[dim_y]++) {
+    for (p[dim_x] = 0; p[dim_x] < DUNGEON_X; p[dim_x]++) {
+      bitboard_update(d, p);
+    }
+  }
+  d->opaque_generation++;
+}
@@ -0,0 +1,39 @@
+#ifndef BITBOARD_H
+# define BITBOARD_H
+
+# include <stdint.h>
+
+# include "dims.h"
+
+typedef struct dungeon dungeon_t;
+
+/* Terrain properties one bit per cell, one 128-bit word per row, with   *
+ * column x in bit x.  The dungeon keeps a board each for passable cells *
+ * (floor of any kind), opaque cells (rock, but not the wizard), and     *
+ * immutable walls.  bitboard_build() makes them from the map after      *
+ * generation or loading; after that, path_cell_opened() and             *
+ * path_cell_closed(), which every change to the map already goes        *
+ * through, keep them current with bitboard_update().                    *
+ *                                                                       *
+ * Single cells are a shift and a mask.  Whole rows are plain integer    *
+ * operations, so neighbor tests and fills can handle a row at a time.   */
+typedef unsigned __int128 bitrow_t;
+
+# define BITROW_ONE ((bitrow_t) 1)
+
+static inline uint32_t bitboard_test(const bitrow_t *board,
+                                     int32_t y, int32_t x)
+{
+  return (board[y] >> x) & 1;
+}
+
+static inline uint32_t bitrow_count(bitrow_t r)
+{
+  return (__builtin_popcountll((uint64_t) r) +
+          __builtin_popcountll((uint64_t) (r >> 64)));
+}
+
+void bitboard_build(dungeon_t *d);
+void bitboard_update(dungeon_t *d, pair_t pos);
+
+#endif
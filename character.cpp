@@ -1,10 +1,15 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "character.h"
 #include "heap.h"
 #include "npc.h"
 #include "pc.h"
 #include "dungeon.h"
+#include "ray.h"
+
+/* Answers are cached for every line in ray.h's table. */
+#define LOS_WORDS ((RAY_SIDE * RAY_SIDE + 63) / 64)
 
 void character_delete(character *c)
 {
@@ -81,6 +86,35 @@ const char *character_get_name(const character *c)
   return c->name;
 }
 
+/* What each cell has found out about seeing the cells in its window, *
+ * since the opacity generation in generation.                        */
+typedef struct los_entry {
+  uint32_t generation;
+  uint64_t known[LOS_WORDS];
+  uint64_t seen[LOS_WORDS];
+} los_entry_t;
+
+struct los_cache {
+  los_entry_t entry[DUNGEON_Y][DUNGEON_X];
+  los_stats_t stats;
+};
+
+los_cache_t *los_cache_new(void)
+{
+  /* Value-initialized, so nothing is known. */
+  return new los_cache_t();
+}
+
+void los_cache_delete(los_cache_t *los)
+{
+  delete los;
+}
+
+const los_stats_t *los_cache_stats(dungeon *d)
+{
+  return &d->los->stats;
+}
+
 uint32_t can_see(dungeon *d, pair_t voyeur, pair_t exhibitionist,
                  int is_pc, int learn)
 {
@@ -90,93 +124,120 @@ uint32_t can_see(dungeon *d, pair_t voyeur, pair_t exhibitionist,
    * based on this approach is not reciprocal (Helmholtz Reciprocity).  *
    * This is a very real problem in roguelike games, and one we're      *
    * going to ignore for now.  Algorithms that are symmetrical are far  *
-   * more expensive.                                                    */
-
-  pair_t first, second;
-  pair_t del, f;
-  int16_t a, b, c, i;
+   * more expensive.  (See fov.h for one that isn't, much.)             *
+   *                                                                    *
+   * The lines come from ray.h, and the answers are cached per viewer   *
+   * until a cell's opacity changes.  Learning has side effects, so it  *
+   * always walks the line.                                             */
+
+  const int8_t (*step)[2];
+  los_entry_t *e;
+  pair_t p;
+  int16_t dy, dx, i, len;
   int16_t visual_range;
+  uint32_t bit, seen;
 
   visual_range = is_pc ? PC_VISUAL_RANGE : NPC_VISUAL_RANGE;
 
-  first[dim_x] = voyeur[dim_x];
-  first[dim_y] = voyeur[dim_y];
-  second[dim_x] = exhibitionist[dim_x];
-  second[dim_y] = exhibitionist[dim_y];
+  dy = exhibitionist[dim_y] - voyeur[dim_y];
+  dx = exhibitionist[dim_x] - voyeur[dim_x];
 
   /* Monsters only use this to see the PC, so we can *
    * short circuit the tests when they are far away. */
-  if ((abs(first[dim_x] - second[dim_x]) > visual_range) ||
-      (abs(first[dim_y] - second[dim_y]) > visual_range)) {
+  if (abs(dx) > visual_range || abs(dy) > visual_range) {
     return 0;
   }
 
-  /*
-  mappair(first) = ter_debug;
-  mappair(second) = ter_debug;
-  */
+  e = &d->los->entry[voyeur[dim_y]][voyeur[dim_x]];
+  if (e->generation != d->opaque_generation) {
+    memset(e->known, 0, sizeof (e->known));
+    e->generation = d->opaque_generation;
+  }
+  bit = (dy + RAY_RANGE) * RAY_SIDE + dx + RAY_RANGE;
+  if (!learn && (e->known[bit >> 6] >> (bit & 63)) & 1) {
+    d->los->stats.hits++;
+    return (e->seen[bit >> 6] >> (bit & 63)) & 1;
+  }
+  d->los->stats.misses++;
+
+  step = rays.step[dy + RAY_RANGE][dx + RAY_RANGE];
+  len = abs(dy) > abs(dx) ? abs(dy) : abs(dx);
+  for (seen = 1, i = 0; i <= len; i++) {
+    p[dim_y] = voyeur[dim_y] + step[i][0];
+    p[dim_x] = voyeur[dim_x] + step[i][1];
+    if (learn) {
+      pc_learn_terrain(d->PC, p, mappair(p));
+      pc_see_object(d->PC, objpair(p));
+    }
+    if (i && i != len && bitboard_test(d->opaque, p[dim_y], p[dim_x])) {
+      seen = 0;
+      break;
+    }
+  }
 
-  if (second[dim_x] > first[dim_x]) {
-    del[dim_x] = second[dim_x] - first[dim_x];
-    f[dim_x] = 1;
+  e->known[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+  if (seen) {
+    e->seen[bit >> 6] |= (uint64_t) 1 << (bit & 63);
   } else {
-    del[dim_x] = first[dim_x] - second[dim_x];
-    f[dim_x] = -1;
+    e->seen[bit >> 6] &= ~((uint64_t) 1 << (bit & 63));
   }
 
-  if (second[dim_y] > first[dim_y]) {
-    del[dim_y] = second[dim_y] - first[dim_y];
-    f[dim_y] = 1;
-  } else {
-    del[dim_y] = first[dim_y] - second[dim_y];
-    f[dim_y] = -1;
+  return seen;
+}
+
+/* Whether the line from (y, x) to the PC is clear, from the line from *
+ * its join on, which is nearer the PC and often already known.  Lines *
+ * go from the monster to the PC, as with can_see(), so the answer is  *
+ * can_see()'s, opaque cell under the monster and all.                 */
+static uint32_t pc_visible_from(dungeon *d, int16_t y, int16_t x)
+{
+  const int8_t (*step)[2];
+  int16_t dy, dx, i, join;
+  uint32_t seen;
+
+  if (bitboard_test(d->pc_visible_known, y, x)) {
+    return bitboard_test(d->pc_visible, y, x);
   }
 
-  if (del[dim_x] > del[dim_y]) {
-    a = del[dim_y] + del[dim_y];
-    c = a - del[dim_x];
-    b = c - del[dim_x];
-    for (i = 0; i <= del[dim_x]; i++) {
-      if (learn) {
-        pc_learn_terrain(d->PC, first, mappair(first));
-        pc_see_object(d->PC, objpair(first));
-      }
-      if ((mappair(first) < ter_floor && mappair(first) != ter_wizard) && i && (i != del[dim_x])) {
-        return 0;
-      }
-      /*      mappair(first) = ter_debug;*/
-      first[dim_x] += f[dim_x];
-      if (c < 0) {
-        c += a;
-      } else {
-        c += b;
-        first[dim_y] += f[dim_y];
-      }
-    }
-    return 1;
+  dy = d->PC->position[dim_y] - y;
+  dx = d->PC->position[dim_x] - x;
+  step = rays.step[dy + RAY_RANGE][dx + RAY_RANGE];
+  join = rays.join[dy + RAY_RANGE][dx + RAY_RANGE];
+
+  for (seen = 1, i = 1; seen && i <= join; i++) {
+    seen = !bitboard_test(d->opaque, y + step[i][0], x + step[i][1]);
+  }
+  if (seen && join) {
+    seen = pc_visible_from(d, y + step[join][0], x + step[join][1]);
+  }
+
+  d->pc_visible_known[y] |= BITROW_ONE << x;
+  if (seen) {
+    d->pc_visible[y] |= BITROW_ONE << x;
   } else {
-    a = del[dim_x] + del[dim_x];
-    c = a - del[dim_y];
-    b = c - del[dim_y];
-    for (i = 0; i <= del[dim_y]; i++) {
-      if (learn) {
-        pc_learn_terrain(d->PC, first, mappair(first));
-        pc_see_object(d->PC, objpair(first));
-      }
-      if ((mappair(first) < ter_floor && mappair(first) != ter_wizard) && i && (i != del[dim_y])) {
-        return 0;
-      }
-      /*      mappair(first) = ter_debug;*/
-      first[dim_y] += f[dim_y];
-      if (c < 0) {
-        c += a;
-      } else {
-        c += b;
-        first[dim_x] += f[dim_x];
-      }
-    }
-    return 1;
+    d->pc_visible[y] &= ~(BITROW_ONE << x);
+  }
+
+  return seen;
+}
+
+uint32_t can_see_pc(dungeon *d, pair_t voyeur)
+{
+  if (!d->pc_visible_valid                                   ||
+      d->pc_visible_at[dim_y] != d->PC->position[dim_y]      ||
+      d->pc_visible_at[dim_x] != d->PC->position[dim_x]      ||
+      d->pc_visible_generation != d->opaque_generation) {
+    memset(d->pc_visible_known, 0, sizeof (d->pc_visible_known));
+    d->pc_visible_at[dim_y] = d->PC->position[dim_y];
+    d->pc_visible_at[dim_x] = d->PC->position[dim_x];
+    d->pc_visible_generation = d->opaque_generation;
+    d->pc_visible_valid = 1;
+  }
+
+  if (abs(d->PC->position[dim_y] - voyeur[dim_y]) > NPC_VISUAL_RANGE ||
+      abs(d->PC->position[dim_x] - voyeur[dim_x]) > NPC_VISUAL_RANGE) {
+    return 0;
   }
 
-  return 1;
+  return pc_visible_from(d, voyeur[dim_y], voyeur[dim_x]);
 }
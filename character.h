@@ -49,6 +49,26 @@ int32_t compare_characters_by_next_turn(const void *character1,
  * farther than the PC.  learn controls whether the PC should learn terrain. */
 uint32_t can_see(dungeon *d, pair_t voyeur, pair_t exhibitionist,
                  int is_pc, int learn);
+
+/* can_see()'s answers, a bit per pair of cells within visual range, good *
+ * until the dungeon's opaque_generation changes.  Each dungeon owns one, *
+ * made by the first init_dungeon() and kept from level to level.         */
+typedef struct los_stats {
+  uint32_t hits;
+  uint32_t misses;
+} los_stats_t;
+
+typedef struct los_cache los_cache_t;
+
+los_cache_t *los_cache_new(void);
+void los_cache_delete(los_cache_t *los);
+const los_stats_t *los_cache_stats(dungeon *d);
+/* Whether a monster at voyeur can see the PC; the same answer as        *
+ * can_see(d, voyeur, PC position, 0, 0).  The answers fill in a field   *
+ * around the PC, cast back from the PC along ray.h's lines, which is    *
+ * kept until the PC moves or the map changes, so the monsters looking   *
+ * for the PC in between mostly cost a bit test or two each.             */
+uint32_t can_see_pc(dungeon *d, pair_t voyeur);
 void character_delete(character *c);
 int16_t *character_get_pos(character *c);
 int16_t character_get_y(const character *c);
@@ -9,244 +9,206 @@
 #include "dungeon.h"
 #include "utils.h"
 #include "heap.h"
+#include "fheap.h"
 #include "event.h"
 #include "pc.h"
 #include "npc.h"
 #include "io.h"
 #include "object.h"
+#include "path.h"
+#include "relax.h"
 
 #define DUMP_HARDNESS_IMAGES 0
 
+/* Corridor carving is the heaviest user of a heap in the game, so it uses *
+ * the template heap, which inlines the comparison.                        */
+struct corridor_path;
+
+struct corridor_path_cmp {
+  inline int32_t operator()(const corridor_path *key,
+                            const corridor_path *with) const;
+};
+
+typedef fheap<corridor_path, corridor_path_cmp> corridor_heap_t;
+
 typedef struct corridor_path {
-  heap_node_t *hn;
+  corridor_heap_t::node *hn;
   uint8_t pos[2];
   uint8_t from[2];
   int32_t cost;
 } corridor_path_t;
 
-static uint32_t in_room(dungeon_t *d, int16_t y, int16_t x)
+inline int32_t corridor_path_cmp::operator()(const corridor_path *key,
+                                             const corridor_path *with) const
 {
-  uint32_t i;
-
-  for (i = 0; i < d->num_rooms; i++) {
-    if ((x >= d->rooms[i].position[dim_x]) &&
-        (x < (d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x])) &&
-        (y >= d->rooms[i].position[dim_y]) &&
-        (y < (d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y]))) {
-      return 1;
-    }
-  }
-
-  return 0;
+  return key->cost - with->cost;
 }
 
-static int32_t corridor_path_cmp(const void *key, const void *with) {
-  return ((corridor_path_t *) key)->cost - ((corridor_path_t *) with)->cost;
-}
-
-static void dijkstra_corridor(dungeon_t *d, pair_t from, pair_t to)
+/* Scratch space for every corridor on a level.  The heap keeps its node *
+ * block from one search to the next, so after the first corridor a      *
+ * search allocates nothing.                                             */
+typedef struct corridor_scratch {
+  corridor_path_t path[DUNGEON_Y][DUNGEON_X];
+  corridor_path_t *data[DUNGEON_Y * DUNGEON_X];
+  corridor_heap_t::node *nodes[DUNGEON_Y * DUNGEON_X];
+  corridor_heap_t h;
+  corridor_scratch();
+} corridor_scratch_t;
+
+corridor_scratch::corridor_scratch()
 {
-  static corridor_path_t path[DUNGEON_Y][DUNGEON_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
-  int32_t x, y;
+  uint32_t x, y;
 
-  if (!initialized) {
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        path[y][x].pos[dim_y] = y;
-        path[y][x].pos[dim_x] = x;
-      }
-    }
-    initialized = 1;
-  }
-  
   for (y = 0; y < DUNGEON_Y; y++) {
     for (x = 0; x < DUNGEON_X; x++) {
-      path[y][x].cost = INT_MAX;
+      path[y][x].pos[dim_y] = y;
+      path[y][x].pos[dim_x] = x;
     }
   }
+}
 
-  path[from[dim_y]][from[dim_x]].cost = 0;
-
-  heap_init(&h, corridor_path_cmp, NULL);
+static inline uint32_t in_room(dungeon_t *d, int16_t y, int16_t x)
+{
+  return d->room_id[y][x];
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) != ter_wall_immutable) {
-        path[y][x].hn = heap_insert(&h, &path[y][x]);
-      } else {
-        path[y][x].hn = NULL;
-      }
-    }
-  }
+/* Rebuilds room_id from the room list.  Rooms only overlap in restored *
+ * dungeons; there the first room in the list wins, so we paint them in *
+ * reverse.                                                             */
+static void index_rooms(dungeon_t *d)
+{
+  uint32_t i;
+  int32_t x, y;
+  room_t *r;
 
-  while ((p = (corridor_path_t *) heap_remove_min(&h))) {
-    p->hn = NULL;
+  memset(d->room_id, 0, sizeof (d->room_id));
 
-    if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
-      for (x = to[dim_x], y = to[dim_y];
-           (x != from[dim_x]) || (y != from[dim_y]);
-           p = &path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
-        if (mapxy(x, y) != ter_floor_room) {
-          mapxy(x, y) = ter_floor_hall;
-          hardnessxy(x, y) = 0;
-        }
+  for (i = d->num_rooms; i; i--) {
+    r = d->rooms + i - 1;
+    for (y = r->position[dim_y]; y < r->position[dim_y] + r->size[dim_y]; y++) {
+      for (x = r->position[dim_x];
+           x < r->position[dim_x] + r->size[dim_x];
+           x++) {
+        d->room_id[y][x] = i;
       }
-      heap_delete(&h);
-      return;
-    }
-
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
-    }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
     }
   }
 }
 
-/* This is a cut-and-paste of the above.  The code is modified to  *
- * calculate paths based on inverse hardnesses so that we get a    *
- * high probability of creating at least one cycle in the dungeon. */
-static void dijkstra_corridor_inv(dungeon_t *d, pair_t from, pair_t to)
-{
-  static corridor_path_t path[DUNGEON_Y][DUNGEON_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
-  int32_t x, y;
+/* Every open cell is in the heap from the start, and "still queued" is *
+ * simply a non-NULL node.                                              */
+struct corridor_search {
+  corridor_scratch_t *s;
+  inline bool queued(uint32_t y, uint32_t x) const
+  {
+    return s->path[y][x].hn;
+  }
+  inline int32_t dist(uint32_t y, uint32_t x) const
+  {
+    return s->path[y][x].cost;
+  }
+  inline void improve(uint32_t y, uint32_t x, int32_t cost,
+                      uint32_t from_y, uint32_t from_x)
+  {
+    corridor_path_t *p = &s->path[y][x];
 
-  if (!initialized) {
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        path[y][x].pos[dim_y] = y;
-        path[y][x].pos[dim_x] = x;
-      }
-    }
-    initialized = 1;
+    p->cost = cost;
+    p->from[dim_y] = from_y;
+    p->from[dim_x] = from_x;
+    s->h.decrease_key_no_replace(p->hn);
   }
-  
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      path[y][x].cost = INT_MAX;
-    }
+};
+
+/* Corridors follow the softest rock, four-connected. */
+struct corridor_policy {
+  static constexpr uint32_t num_neighbors = 4;
+  static constexpr const neighbor_t *neighbor = neighbors4;
+  dungeon_t *d;
+  inline bool open(uint32_t y, uint32_t x) const
+  {
+    return mapxy(x, y) != ter_wall_immutable;
+  }
+  inline int32_t cost(uint32_t y, uint32_t x) const
+  {
+    return hardnessxy(x, y);
   }
+};
 
-  path[from[dim_y]][from[dim_x]].cost = 0;
+/* Same thing with inverse hardnesses, so that we get a high probability *
+ * of creating at least one cycle in the dungeon.                        */
+struct corridor_inv_policy {
+  static constexpr uint32_t num_neighbors = 4;
+  static constexpr const neighbor_t *neighbor = neighbors4;
+  dungeon_t *d;
+  inline bool open(uint32_t y, uint32_t x) const
+  {
+    return mapxy(x, y) != ter_wall_immutable;
+  }
+  inline int32_t cost(uint32_t y, uint32_t x) const
+  {
+    return in_room(d, y, x) ? 224 : 255 - hardnessxy(x, y);
+  }
+};
 
-  heap_init(&h, corridor_path_cmp, NULL);
+/* Dijkstra from from until it pops to.  Corridors decide the layout of *
+ * the level, and among equally cheap routes the one carved is whichever *
+ * the heap happens to pop first, so this has to feed the heap exactly   *
+ * as the original code did: every open cell, in row order, by cost      *
+ * alone.  The template heap pops in the same order as heap.c, so seeded *
+ * levels come out the same as they always have.                        */
+template <class Policy>
+static void dijkstra_corridor(dungeon_t *d, corridor_scratch_t *s,
+                              pair_t from, pair_t to)
+{
+  Policy policy = { d };
+  corridor_search search = { s };
+  corridor_path_t *p;
+  uint32_t i, n;
+  int32_t x, y;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
+  for (n = 0, y = 0; y < DUNGEON_Y; y++) {
     for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) != ter_wall_immutable) {
-        path[y][x].hn = heap_insert(&h, &path[y][x]);
+      s->path[y][x].cost = INT_MAX;
+      if (policy.open(y, x)) {
+        s->data[n++] = &s->path[y][x];
       } else {
-        path[y][x].hn = NULL;
+        s->path[y][x].hn = NULL;
       }
     }
   }
+  s->path[from[dim_y]][from[dim_x]].cost = 0;
+
+  s->h.build(s->data, n, s->nodes);
+  for (i = 0; i < n; i++) {
+    s->data[i]->hn = s->nodes[i];
+  }
 
-  while ((p = (corridor_path_t *) heap_remove_min(&h))) {
+  while ((p = s->h.remove_min())) {
     p->hn = NULL;
 
     if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
       for (x = to[dim_x], y = to[dim_y];
            (x != from[dim_x]) || (y != from[dim_y]);
-           p = &path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
+           p = &s->path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
         if (mapxy(x, y) != ter_floor_room) {
           mapxy(x, y) = ter_floor_hall;
           hardnessxy(x, y) = 0;
         }
       }
-      heap_delete(&h);
-      return;
-    }
-
-#define hardnesspair_inv(p) (in_room(d, p[dim_y], p[dim_x]) ? \
-                             224                            : \
-                             (255 - hardnesspair(p)))
-
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
-    }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
+      break;
     }
+
+    relax(policy, search, p->pos[dim_y], p->pos[dim_x]);
   }
+
+  s->h.reset();
 }
 
 /* Chooses a random point inside each room and connects them with a *
  * corridor.  Random internal points prevent corridors from exiting *
  * rooms in predictable locations.                                  */
-static int connect_two_rooms(dungeon_t *d, room_t *r1, room_t *r2)
+static int connect_two_rooms(dungeon_t *d, corridor_scratch_t *s,
+                             room_t *r1, room_t *r2)
 {
   pair_t e1, e2;
 
@@ -260,12 +222,12 @@ static int connect_two_rooms(dungeon_t *d, room_t *r1, room_t *r2)
                          r2->position[dim_x] + r2->size[dim_x] - 1);
 
   /*  return connect_two_points_recursive(d, e1, e2);*/
-  dijkstra_corridor(d, e1, e2);
+  dijkstra_corridor<corridor_policy>(d, s, e1, e2);
 
   return 0;
 }
 
-static int create_cycle(dungeon_t *d)
+static int create_cycle(dungeon_t *d, corridor_scratch_t *s)
 {
   /* Find the (approximately) farthest two rooms, then connect *
    * them by the shortest path using inverted hardnesses.      */
@@ -303,20 +265,25 @@ static int create_cycle(dungeon_t *d)
                          (d->rooms[q].position[dim_x] +
                           d->rooms[q].size[dim_x] - 1));
 
-  dijkstra_corridor_inv(d, e1, e2);
+  dijkstra_corridor<corridor_inv_policy>(d, s, e1, e2);
 
   return 0;
 }
 
 static int connect_rooms(dungeon_t *d)
 {
+  corridor_scratch_t *s;
   uint32_t i;
 
+  s = new corridor_scratch_t;
+
   for (i = 1; i < d->num_rooms; i++) {
-    connect_two_rooms(d, d->rooms + i - 1, d->rooms + i);
+    connect_two_rooms(d, s, d->rooms + i - 1, d->rooms + i);
   }
 
-  create_cycle(d);
+  create_cycle(d, s);
+
+  delete s;
 
   return 0;
 }
@@ -509,6 +476,7 @@ static int empty_dungeon(dungeon_t *d)
       charxy(x, y) = NULL;
     }
   }
+  memset(d->room_id, 0, sizeof (d->room_id));
 
   return 0;
 }
@@ -547,6 +515,8 @@ static int place_rooms(dungeon_t *d)
     }
   }
 
+  index_rooms(d);
+
   return 0;
 }
 
@@ -606,6 +576,10 @@ void place_wizard(dungeon_t *d)
     
     mappair(p) = ter_wizard;
     hardnesspair(p) = 255;
+
+    /* The wizard closes off a floor cell, which can only make paths *
+     * longer, so the distance maps can't be repaired incrementally. */
+    path_cell_closed(d, p);
   }
 }
 
@@ -618,6 +592,7 @@ int gen_dungeon(dungeon_t *d)
   } while (place_rooms(d));
   connect_rooms(d);
   place_stairs(d);
+  bitboard_build(d);
   return 0;
 }
 
@@ -627,13 +602,31 @@ void delete_dungeon(dungeon_t *d)
   heap_delete(&d->events);
   memset(d->character_map, 0, sizeof (d->character_map));
   destroy_objects(d);
+  path_context_delete(d->path_ctx);
 }
 
 void init_dungeon(dungeon_t *d)
 {
   empty_dungeon(d);
+  d->path_dirty = 1;
+  d->path_num_pending = 0;
+  d->map_generation = 0;
+  d->tunnel_generation = 0;
+  d->target_dirty = (1 << num_path_targets) - 1;
+  d->pc_visible_valid = 0;
+  d->path_ctx = path_context_new(d);
+  /* The sight cache is big and its entries are stamped with the  *
+   * opacity generation, which never repeats, so it outlives levels. */
+  if (!d->los) {
+    d->los = los_cache_new();
+  }
   memset(&d->events, 0, sizeof (d->events));
   heap_init(&d->events, compare_events, event_delete);
+  /* One event per character, so this is all the events queue ever needs. */
+  if (heap_reserve(&d->events, d->max_monsters + 1)) {
+    perror("heap_reserve");
+    exit(1);
+  }
 }
 
 int write_dungeon_map(dungeon_t *d, FILE *f)
@@ -809,6 +802,8 @@ int read_rooms(dungeon_t *d, FILE *f)
     }
   }
 
+  index_rooms(d);
+
   return 0;
 }
 
@@ -889,6 +884,7 @@ int read_dungeon(dungeon_t *d, char *file)
   d->num_rooms = calculate_num_rooms(buf.st_size);
   d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
   read_rooms(d, f);
+  bitboard_build(d);
 
   fclose(f);
 
@@ -963,6 +959,7 @@ int read_pgm(dungeon_t *d, char *pgm)
       }
     }
   }
+  index_rooms(d);
 
   for (x = 0; x < DUNGEON_X; x++) {
     d->map[0][x] = ter_wall_immutable;
@@ -976,6 +973,7 @@ int read_pgm(dungeon_t *d, char *pgm)
     d->map[y][DUNGEON_X - 1] = ter_wall_immutable;
     d->hardness[y][DUNGEON_X - 1] = 255;
   }
+  bitboard_build(d);
 
   return 0;
 }
@@ -994,6 +992,7 @@ void new_dungeon(dungeon_t *d)
   
   place_pc(d);
   d->character_map[d->PC->position[dim_y]][d->PC->position[dim_x]] = d->PC;
+  path_invalidate(d);
 
   gen_monsters(d);
   gen_objects(d);
@@ -7,6 +7,8 @@
 # include "dims.h"
 # include "character.h"
 # include "descriptions.h"
+# include "path.h"
+# include "bitboard.h"
 
 #define DUNGEON_X              80
 #define DUNGEON_Y              21
@@ -64,6 +66,9 @@ class dungeon {
  public:
   uint32_t num_rooms;
   room_t *rooms;
+  /* The room each cell is in, as an index into rooms plus one, or 0 for *
+   * none.  16 bits because read_pgm() makes every room pixel a room.    */
+  uint16_t room_id[DUNGEON_Y][DUNGEON_X];
   terrain_type_t map[DUNGEON_Y][DUNGEON_X];
   /* Since hardness is usually not used, it would be expensive to pull it *
    * into cache every time we need a map cell, so we store it in a        *
@@ -74,8 +79,39 @@ class dungeon {
    * and pulling in unnecessary data with each map cell would add a lot   *
    * of overhead to the memory system.                                    */
   uint8_t hardness[DUNGEON_Y][DUNGEON_X];
+  /* The map again, a bit per cell; see bitboard.h. */
+  bitrow_t passable[DUNGEON_Y];
+  bitrow_t opaque[DUNGEON_Y];
+  bitrow_t immutable[DUNGEON_Y];
+  /* Bumped whenever a cell of opaque changes, including every rebuild. *
+   * Never reset, so it stays unique across levels.                     */
+  uint32_t opaque_generation;
   uint8_t pc_distance[DUNGEON_Y][DUNGEON_X];
   uint8_t pc_tunnel[DUNGEON_Y][DUNGEON_X];
+  /* The two maps above are only valid after path_update().  See path.h. */
+  uint32_t path_dirty;
+  uint32_t path_num_pending;
+  pair_t path_pending[PATH_MAX_PENDING_REPAIRS];
+  path_stats_t path_stats;
+  path_context_t *path_ctx;
+  los_cache_t *los;
+  /* Bumped on every change to the terrain after generation. */
+  uint32_t map_generation;
+  /* Bumped on every change to hardness, including the terrain changes *
+   * that come with one; only the tunneling map depends on it.         */
+  uint32_t tunnel_generation;
+  /* Distance to the nearest target of each kind; see path.h. */
+  uint8_t target_distance[num_path_targets][DUNGEON_Y][DUNGEON_X];
+  uint32_t target_generation[num_path_targets];
+  uint32_t target_dirty;
+  /* Cells a monster can see the PC from, as a bitboard, for the cells *
+   * in pc_visible_known; only valid for pc_visible_at and             *
+   * pc_visible_generation.  See can_see_pc().                         */
+  bitrow_t pc_visible[DUNGEON_Y];
+  bitrow_t pc_visible_known[DUNGEON_Y];
+  pair_t pc_visible_at;
+  uint32_t pc_visible_generation;
+  uint32_t pc_visible_valid;
   character *character_map[DUNGEON_Y][DUNGEON_X];
   object *objmap[DUNGEON_Y][DUNGEON_X];
   pc *PC;
@@ -0,0 +1,324 @@
+#ifndef FHEAP_H
+# define FHEAP_H
+
+# include <stdint.h>
+# include <string.h>
+
+/* A template version of the Fibonacci heap in heap.c.  The comparator is *
+ * a functor type rather than a function pointer, so the compiler can     *
+ * inline it into every comparison; anything the comparison needs (a      *
+ * distance map, say) lives in the functor instead of in a global.  The   *
+ * algorithm is identical to heap.c, down to the order of operations, so  *
+ * the two produce the same removal order for the same input.             *
+ *                                                                        *
+ * Compare must provide int32_t operator()(const T *key, const T *with),  *
+ * returning less than, equal to, or greater than zero, like heap.c's     *
+ * comparators.  The heap never owns the data.                            */
+
+template <class T, class Compare>
+class fheap {
+ public:
+  class node {
+    friend class fheap;
+    node *next;
+    node *prev;
+    node *parent;
+    node *child;
+    T *datum;
+    uint32_t degree;
+    uint32_t mark;
+  };
+
+  fheap(const Compare &c = Compare()) :
+    min(0), size(0), compare(c), block(0), block_size(0), block_used(0) {}
+  ~fheap() { reset(); delete [] block; }
+
+  inline uint32_t get_size() const { return size; }
+  inline T *peek_min() const { return min ? min->datum : 0; }
+
+  /* See heap_reset(). */
+  void reset()
+  {
+    if (min) {
+      delete_nodes(min);
+    }
+    min = 0;
+    size = 0;
+    block_used = 0;
+  }
+
+  /* See heap_reserve().  Inserts take nodes from the block until the *
+   * next reset(), so a search that inserts each cell at most once    *
+   * never allocates.  Only possible on an empty heap.                */
+  int reserve(uint32_t n)
+  {
+    if (min) {
+      return 1;
+    }
+
+    if (block_size < n) {
+      delete [] block;
+      block = new node[n];
+      block_size = n;
+    }
+    block_used = 0;
+
+    return 0;
+  }
+
+  node *insert(T *v)
+  {
+    node *n;
+
+    if (block_used < block_size) {
+      n = &block[block_used++];
+      memset(n, 0, sizeof (*n));
+    } else {
+      n = new node();
+    }
+    n->datum = v;
+    insert_node(n);
+
+    return n;
+  }
+
+  /* See heap_build() and heap_reset(). */
+  int build(T **v, uint32_t n, node **nodes)
+  {
+    uint32_t i;
+
+    if (min) {
+      return 1;
+    }
+
+    if (block_size < n) {
+      delete [] block;
+      block = new node[n];
+      block_size = n;
+    }
+    memset(block, 0, n * sizeof (*block));
+    block_used = n;
+
+    for (i = 0; i < n; i++) {
+      block[i].datum = v[i];
+      insert_node(&block[i]);
+      if (nodes) {
+        nodes[i] = &block[i];
+      }
+    }
+
+    return 0;
+  }
+
+  T *remove_min()
+  {
+    T *v;
+    node *n;
+
+    v = 0;
+
+    if (min) {
+      v = min->datum;
+      if (size == 1) {
+        free_node(min);
+        min = 0;
+      } else {
+        if ((n = min->child)) {
+          for (; n->parent; n = n->next) {
+            n->parent = 0;
+          }
+        }
+
+        splice_lists(min, min->child);
+
+        n = min;
+        remove_from_list(n);
+        min = n->next;
+        free_node(n);
+
+        consolidate();
+      }
+
+      size--;
+    }
+
+    return v;
+  }
+
+  /* As with heap_decrease_key_no_replace(), the caller has already *
+   * lowered the key in place and is responsible for it not having  *
+   * gone up.                                                       */
+  void decrease_key_no_replace(node *n)
+  {
+    node *p;
+
+    p = n->parent;
+
+    if (p && (compare(n->datum, p->datum) < 0)) {
+      cut(n, p);
+      cascading_cut(p);
+    }
+    if (compare(n->datum, min->datum) < 0) {
+      min = n;
+    }
+  }
+
+ private:
+  node *min;
+  uint32_t size;
+  Compare compare;
+  node *block;
+  uint32_t block_size;
+  uint32_t block_used;
+
+  fheap(const fheap &);
+  fheap &operator=(const fheap &);
+
+  inline bool in_block(node *n) const
+  {
+    return n >= block && n < block + block_size;
+  }
+
+  inline void free_node(node *n)
+  {
+    if (!in_block(n)) {
+      delete n;
+    }
+  }
+
+  void insert_node(node *n)
+  {
+    if (min) {
+      insert_in_list(n, min);
+    } else {
+      n->next = n->prev = n;
+    }
+    if (!min || (compare(n->datum, min->datum) < 0)) {
+      min = n;
+    }
+    size++;
+  }
+
+  static inline void splice_lists(node *n1, node *n2)
+  {
+    if (n1 && n2) {
+      n1->next->prev = n2->prev;
+      n2->prev->next = n1->next;
+      n1->next = n2;
+      n2->prev = n1;
+    }
+  }
+
+  static inline void insert_in_list(node *n, node *l)
+  {
+    n->next = l;
+    n->prev = l->prev;
+    n->prev->next = n;
+    l->prev = n;
+  }
+
+  static inline void remove_from_list(node *n)
+  {
+    n->next->prev = n->prev;
+    n->prev->next = n->next;
+  }
+
+  void delete_nodes(node *n)
+  {
+    node *next;
+
+    n->prev->next = 0;
+    while (n) {
+      if (n->child) {
+        delete_nodes(n->child);
+      }
+      next = n->next;
+      free_node(n);
+      n = next;
+    }
+  }
+
+  static inline void link(node *n, node *root)
+  {
+    if (root->child) {
+      insert_in_list(n, root->child);
+    } else {
+      root->child = n;
+      n->next = n->prev = n;
+    }
+    n->parent = root;
+    root->degree++;
+    n->mark = 0;
+  }
+
+  void consolidate()
+  {
+    uint32_t i;
+    node *x, *y, *n, *t;
+    node *a[64]; /* See heap_consolidate() */
+
+    memset(a, 0, sizeof (a));
+
+    min->prev->next = 0;
+
+    for (x = n = min; n; x = n) {
+      n = n->next;
+
+      while (a[x->degree]) {
+        y = a[x->degree];
+        if (compare(x->datum, y->datum) > 0) {
+          t = x;
+          x = y;
+          y = t;
+        }
+        a[x->degree] = 0;
+        link(y, x);
+      }
+      a[x->degree] = x;
+    }
+
+    for (min = 0, i = 0; i < 64; i++) {
+      if (a[i]) {
+        if (min) {
+          insert_in_list(a[i], min);
+          if (compare(a[i]->datum, min->datum) < 0) {
+            min = a[i];
+          }
+        } else {
+          min = a[i];
+          a[i]->next = a[i]->prev = a[i];
+        }
+      }
+    }
+  }
+
+  void cut(node *n, node *p)
+  {
+    if (!--p->degree) {
+      p->child = 0;
+    }
+    if (p->child == n) {
+      p->child = p->child->next;
+    }
+    remove_from_list(n);
+    n->parent = 0;
+    n->mark = 0;
+    insert_in_list(n, min);
+  }
+
+  void cascading_cut(node *n)
+  {
+    node *p;
+
+    if ((p = n->parent)) {
+      if (!n->mark) {
+        n->mark = 1;
+      } else {
+        cut(n, p);
+        cascading_cut(n);
+      }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef FOV_H
+# define FOV_H
+
+# include <stdint.h>
+# include <string.h>
+
+# include "dungeon.h"
+
+/* Field of view by symmetric shadowcasting (after Albert Ford).  The    *
+ * view is cast a row at a time outward from the origin in each of four  *
+ * quadrants, carrying the slopes of the shadows the walls throw, so a   *
+ * cell is only looked at if light can reach it.  The cost is in the     *
+ * number of cells in view, not the area of the box, so the visual       *
+ * ranges can grow without everything else growing with their square.    *
+ *                                                                       *
+ * A floor cell is in view exactly when the origin would be in view from *
+ * it, so whoever the PC can see can see the PC; unlike with Bresenham   *
+ * rays, there's no seeing someone who can't see you.  Walls are in view *
+ * if light reaches their face.  The view is a square, as the ray box    *
+ * was, and only d->opaque blocks it, as it blocks can_see().            *
+ *                                                                       *
+ * Only the PC's knowledge map comes from here.  Monsters look for the   *
+ * PC along can_see()'s lines (see can_see_pc()), which needn't agree:   *
+ * a monster inside rock, or around some corners, can see a PC it isn't  *
+ * in view of, and the other way around.                                 */
+
+/* Where depth rows out and col columns across lands in each quadrant. */
+typedef struct fov_quadrant {
+  int8_t row_y, row_x;
+  int8_t col_y, col_x;
+} fov_quadrant_t;
+
+constexpr fov_quadrant_t fov_quadrants[4] = {
+  { -1,  0,  0,  1 }, /* North */
+  {  0,  1,  1,  0 }, /* East  */
+  {  1,  0,  0,  1 }, /* South */
+  {  0, -1,  1,  0 }  /* West  */
+};
+
+# define fov_opaque(y, x) bitboard_test(d->opaque, y, x)
+
+/* Slopes are fractions n / d, d > 0, kept exact in integers. */
+static inline int32_t fov_floor_div(int32_t n, int32_t d)
+{
+  return n / d - (n % d < 0);
+}
+
+template <class Visit>
+class fov_caster {
+ public:
+  fov_caster(dungeon_t *dungeon, pair_t origin, int32_t range, Visit &v) :
+    d(dungeon), oy(origin[dim_y]), ox(origin[dim_x]), r(range), visit(v)
+  {
+    memset(seen, 0, sizeof (seen));
+  }
+
+  void cast()
+  {
+    reveal(oy, ox);
+    for (q = fov_quadrants; q < fov_quadrants + 4; q++) {
+      scan(1, -1, 1, 1, 1);
+    }
+  }
+
+ private:
+  dungeon_t *d;
+  int32_t oy, ox, r;
+  Visit &visit;
+  const fov_quadrant_t *q;
+  /* Neighboring quadrants share their diagonals. */
+  uint32_t seen[DUNGEON_Y][(DUNGEON_X + 31) / 32];
+
+  inline void reveal(int32_t y, int32_t x)
+  {
+    if (!(seen[y][x >> 5] & (1U << (x & 31)))) {
+      seen[y][x >> 5] |= 1U << (x & 31);
+      visit(y, x);
+    }
+  }
+
+  /* One row, between the start and end slopes.  Starts the next row *
+   * below every run of open cells.                                   */
+  void scan(int32_t depth, int32_t start_n, int32_t start_d,
+            int32_t end_n, int32_t end_d)
+  {
+    int32_t col, max_col, y, x, wall, prev;
+
+    if (depth > r) {
+      return;
+    }
+
+    col = fov_floor_div(2 * depth * start_n + start_d, 2 * start_d);
+    max_col = -fov_floor_div(end_d - 2 * depth * end_n, 2 * end_d);
+    for (prev = -1; col <= max_col; col++, prev = wall) {
+      y = oy + depth * q->row_y + col * q->col_y;
+      x = ox + depth * q->row_x + col * q->col_x;
+      if (y < 0 || y >= DUNGEON_Y || x < 0 || x >= DUNGEON_X) {
+        wall = 1;
+      } else {
+        wall = fov_opaque(y, x);
+        /* Floor is only lit if the origin's center can see its center. */
+        if (wall || (col * start_d >= depth * start_n &&
+                     col * end_d <= depth * end_n)) {
+          reveal(y, x);
+        }
+      }
+      if (prev == 1 && !wall) {
+        start_n = 2 * col - 1;
+        start_d = 2 * depth;
+      }
+      if (prev == 0 && wall) {
+        scan(depth + 1, start_n, start_d, 2 * col - 1, 2 * depth);
+      }
+    }
+    if (prev == 0) {
+      scan(depth + 1, start_n, start_d, end_n, end_d);
+    }
+  }
+};
+
+/* Calls visit(y, x) once for every cell within range (a square) of *
+ * origin that's in view from it, origin included.                  */
+template <class Visit>
+inline void fov_cast(dungeon_t *d, pair_t origin, int32_t range, Visit visit)
+{
+  fov_caster<Visit>(d, origin, range, visit).cast();
+}
+
+#endif
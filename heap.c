@@ -11,8 +11,25 @@ struct heap_node {
   void *datum;
   uint32_t degree;
   uint32_t mark;
+  uint32_t index; /* Slot in a d-ary heap; unused by Fibonacci heaps */
 };
 
+struct heap_chunk {
+  struct heap_chunk *next;
+  heap_node_t node[];
+};
+
+/* The pool and the d-ary slot array both double when they run out. */
+#define HEAP_POOL_MIN_CHUNK 16
+
+#define heap_compare(h, key, with)                   \
+  ((h)->compare_r                                    \
+   ? (h)->compare_r((key), (with), (h)->compare_arg) \
+   : (h)->compare((key), (with)))
+
+#define heap_node_in_block(h, n)                     \
+  ((n) >= (h)->block && (n) < (h)->block + (h)->block_size)
+
 #define splice_heap_node_lists(n1, n2) ({ \
   if ((n1) && (n2)) {                     \
     (n1)->next->prev = (n2)->prev;        \
@@ -90,7 +107,132 @@ void heap_init(heap_t *h,
   h->min = NULL;
   h->size = 0;
   h->compare = compare;
+  h->compare_r = NULL;
+  h->compare_arg = NULL;
+  h->datum_delete = datum_delete;
+  h->block = NULL;
+  h->block_size = 0;
+  h->chunks = NULL;
+  h->free_nodes = NULL;
+  memset(&h->pool, 0, sizeof (h->pool));
+  h->backend = HEAP_DEFAULT_BACKEND;
+  h->slots = NULL;
+  h->slots_size = 0;
+}
+
+void heap_init_r(heap_t *h,
+                 int32_t (*compare)(const void *key, const void *with,
+                                    void *arg),
+                 void *arg,
+                 void (*datum_delete)(void *))
+{
+  h->min = NULL;
+  h->size = 0;
+  h->compare = NULL;
+  h->compare_r = compare;
+  h->compare_arg = arg;
   h->datum_delete = datum_delete;
+  h->block = NULL;
+  h->block_size = 0;
+  h->chunks = NULL;
+  h->free_nodes = NULL;
+  memset(&h->pool, 0, sizeof (h->pool));
+  h->backend = HEAP_DEFAULT_BACKEND;
+  h->slots = NULL;
+  h->slots_size = 0;
+}
+
+int heap_set_backend(heap_t *h, heap_backend_t backend)
+{
+  if (h->size) {
+    return 1;
+  }
+  h->backend = backend;
+
+  return 0;
+}
+
+static int heap_dary_reserve_slots(heap_t *h, uint32_t n)
+{
+  heap_node_t **slots;
+
+  if (h->slots_size >= n) {
+    return 0;
+  }
+  if (n < 2 * h->slots_size) {
+    n = 2 * h->slots_size;
+  }
+  if (n < HEAP_POOL_MIN_CHUNK) {
+    n = HEAP_POOL_MIN_CHUNK;
+  }
+  if (!(slots = realloc(h->slots, n * sizeof (*h->slots)))) {
+    return 1;
+  }
+  h->slots = slots;
+  h->slots_size = n;
+
+  return 0;
+}
+
+int heap_reserve(heap_t *h, uint32_t n)
+{
+  struct heap_chunk *c;
+  uint32_t i;
+
+  if (h->backend == heap_backend_dary &&
+      heap_dary_reserve_slots(h, h->size + n)) {
+    return 1;
+  }
+
+  if (h->pool.free >= n) {
+    return 0;
+  }
+  n -= h->pool.free;
+
+  if (!(c = malloc(sizeof (*c) + n * sizeof (c->node[0])))) {
+    return 1;
+  }
+  c->next = h->chunks;
+  h->chunks = c;
+  for (i = 0; i < n; i++) {
+    c->node[i].next = h->free_nodes;
+    h->free_nodes = &c->node[i];
+  }
+
+  h->pool.allocations++;
+  h->pool.nodes += n;
+  h->pool.free += n;
+
+  return 0;
+}
+
+static heap_node_t *heap_node_alloc(heap_t *h)
+{
+  heap_node_t *n;
+
+  if (!h->free_nodes &&
+      heap_reserve(h, h->pool.nodes ? h->pool.nodes : HEAP_POOL_MIN_CHUNK)) {
+    return NULL;
+  }
+
+  n = h->free_nodes;
+  h->free_nodes = n->next;
+  h->pool.free--;
+  memset(n, 0, sizeof (*n));
+
+  return n;
+}
+
+/* Nodes from a heap_build() block belong to the block, not the pool. */
+static void heap_node_free(heap_t *h, heap_node_t *n)
+{
+  if (heap_node_in_block(h, n)) {
+    return;
+  }
+
+  n->next = h->free_nodes;
+  h->free_nodes = n;
+  h->pool.free++;
 }
 
 void heap_node_delete(heap_t *h, heap_node_t *hn)
@@ -106,44 +248,193 @@ void heap_node_delete(heap_t *h, heap_node_t *hn)
     if (h->datum_delete) {
       h->datum_delete(hn->datum);
     }
-    free(hn);
+    heap_node_free(h, hn);
     hn = next;
   }
 }
 
-void heap_delete(heap_t *h)
+void heap_reset(heap_t *h)
 {
-  if (h->min) {
+  uint32_t i;
+
+  if (h->backend == heap_backend_dary) {
+    for (i = 0; i < h->size; i++) {
+      if (h->datum_delete) {
+        h->datum_delete(h->slots[i]->datum);
+      }
+      heap_node_free(h, h->slots[i]);
+    }
+  } else if (h->min) {
     heap_node_delete(h, h->min);
   }
   h->min = NULL;
   h->size = 0;
+}
+
+void heap_delete(heap_t *h)
+{
+  struct heap_chunk *c;
+
+  heap_reset(h);
+  free(h->block);
+  h->block = NULL;
+  h->block_size = 0;
+  while ((c = h->chunks)) {
+    h->chunks = c->next;
+    free(c);
+  }
+  h->free_nodes = NULL;
+  memset(&h->pool, 0, sizeof (h->pool));
+  free(h->slots);
+  h->slots = NULL;
+  h->slots_size = 0;
   h->compare = NULL;
+  h->compare_r = NULL;
+  h->compare_arg = NULL;
   h->datum_delete = NULL;
 }
 
-heap_node_t *heap_insert(heap_t *h, void *v)
+/* The d-ary heap.  slots[0] is the minimum, the children of slot i are *
+ * slots i * HEAP_DARY_ARITY + 1 through i * HEAP_DARY_ARITY + ARITY,   *
+ * and every node knows its own slot.  Sifts move a hole rather than    *
+ * swapping, so each level costs one store and one index update.        */
+static void heap_dary_sift_up(heap_t *h, uint32_t i)
 {
   heap_node_t *n;
+  uint32_t p;
 
-  n = calloc(1, sizeof (*n));
-  n->datum = v;
+  n = h->slots[i];
+  while (i) {
+    p = (i - 1) / HEAP_DARY_ARITY;
+    if (heap_compare(h, n->datum, h->slots[p]->datum) >= 0) {
+      break;
+    }
+    h->slots[i] = h->slots[p];
+    h->slots[i]->index = i;
+    i = p;
+  }
+  h->slots[i] = n;
+  n->index = i;
+}
+
+static void heap_dary_sift_down(heap_t *h, uint32_t i)
+{
+  heap_node_t *n;
+  uint32_t c, j, end, best;
+
+  n = h->slots[i];
+  while ((c = i * HEAP_DARY_ARITY + 1) < h->size) {
+    end = c + HEAP_DARY_ARITY;
+    if (end > h->size) {
+      end = h->size;
+    }
+    for (best = c, j = c + 1; j < end; j++) {
+      if (heap_compare(h, h->slots[j]->datum, h->slots[best]->datum) < 0) {
+        best = j;
+      }
+    }
+    if (heap_compare(h, h->slots[best]->datum, n->datum) >= 0) {
+      break;
+    }
+    h->slots[i] = h->slots[best];
+    h->slots[i]->index = i;
+    i = best;
+  }
+  h->slots[i] = n;
+  n->index = i;
+}
+
+static void heap_insert_node(heap_t *h, heap_node_t *n)
+{
+  if (h->backend == heap_backend_dary) {
+    h->slots[h->size] = n;
+    heap_dary_sift_up(h, h->size++);
+    return;
+  }
 
   if (h->min) {
     insert_heap_node_in_list(n, h->min);
   } else {
     n->next = n->prev = n;
   }
-  if (!h->min || (h->compare(v, h->min->datum) < 0)) {
+  if (!h->min || (heap_compare(h, n->datum, h->min->datum) < 0)) {
     h->min = n;
   }
   h->size++;
+}
+
+heap_node_t *heap_insert(heap_t *h, void *v)
+{
+  heap_node_t *n;
+
+  if ((h->backend == heap_backend_dary &&
+       heap_dary_reserve_slots(h, h->size + 1)) ||
+      !(n = heap_node_alloc(h))) {
+    return NULL;
+  }
+  n->datum = v;
+  heap_insert_node(h, n);
 
   return n;
 }
 
+int heap_build(heap_t *h, void **v, uint32_t n, heap_node_t **nodes)
+{
+  heap_node_t *block;
+  uint32_t i;
+
+  if (h->size) {
+    return 1;
+  }
+
+  if (h->backend == heap_backend_dary && heap_dary_reserve_slots(h, n)) {
+    return 1;
+  }
+
+  if (h->block_size < n) {
+    if (!(block = malloc(n * sizeof (*h->block)))) {
+      return 1;
+    }
+    free(h->block);
+    h->block = block;
+    h->block_size = n;
+  }
+  memset(h->block, 0, n * sizeof (*h->block));
+
+  if (h->backend == heap_backend_dary) {
+    for (i = 0; i < n; i++) {
+      h->block[i].datum = v[i];
+      h->slots[i] = &h->block[i];
+      h->block[i].index = i;
+      if (nodes) {
+        nodes[i] = &h->block[i];
+      }
+    }
+    h->size = n;
+    /* Sift down every slot with a child, last first. */
+    for (i = (n + HEAP_DARY_ARITY - 2) / HEAP_DARY_ARITY; i--; ) {
+      heap_dary_sift_down(h, i);
+    }
+    return 0;
+  }
+
+  for (i = 0; i < n; i++) {
+    h->block[i].datum = v[i];
+    heap_insert_node(h, &h->block[i]);
+    if (nodes) {
+      nodes[i] = &h->block[i];
+    }
+  }
+
+  return 0;
+}
+
 void *heap_peek_min(heap_t *h)
 {
+  if (h->backend == heap_backend_dary) {
+    return h->size ? h->slots[0]->datum : NULL;
+  }
+
   return h->min ? h->min->datum : NULL;
 }
 
@@ -178,7 +469,7 @@ static void heap_consolidate(heap_t *h)
 
     while (a[x->degree]) {
       y = a[x->degree];
-      if (h->compare(x->datum, y->datum) > 0) {
+      if (heap_compare(h, x->datum, y->datum) > 0) {
         swap(x, y);
       }
       a[x->degree] = NULL;
@@ -191,7 +482,7 @@ static void heap_consolidate(heap_t *h)
     if (a[i]) {
       if (h->min) {
         insert_heap_node_in_list(a[i], h->min);
-        if (h->compare(a[i]->datum, h->min->datum) < 0) {
+        if (heap_compare(h, a[i]->datum, h->min->datum) < 0) {
           h->min = a[i];
         }
       } else {
@@ -209,10 +500,23 @@ void *heap_remove_min(heap_t *h)
 
   v = NULL;
 
+  if (h->backend == heap_backend_dary) {
+    if (h->size) {
+      n = h->slots[0];
+      v = n->datum;
+      if (--h->size) {
+        h->slots[0] = h->slots[h->size];
+        heap_dary_sift_down(h, 0);
+      }
+      heap_node_free(h, n);
+    }
+    return v;
+  }
+
   if (h->min) {
     v = h->min->datum;
     if (h->size == 1) {
-      free(h->min);
+      heap_node_free(h, h->min);
       h->min = NULL;
     } else {
       if ((n = h->min->child)) {
@@ -226,7 +530,7 @@ void *heap_remove_min(heap_t *h)
       n = h->min;
       remove_heap_node_from_list(n);
       h->min = n->next;
-      free(n);
+      heap_node_free(h, n);
 
       heap_consolidate(h);
     }
@@ -239,13 +543,49 @@ void *heap_remove_min(heap_t *h)
 
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
 {
+  struct heap_chunk *c;
+  heap_node_t *n;
+
   if (h1->compare != h2->compare ||
-      h1->datum_delete != h2->datum_delete) {
+      h1->compare_r != h2->compare_r ||
+      h1->compare_arg != h2->compare_arg ||
+      h1->datum_delete != h2->datum_delete ||
+      h1->block || h2->block ||
+      h1->backend != heap_backend_fibonacci ||
+      h2->backend != heap_backend_fibonacci) {
     return 1;
   }
 
   h->compare = h1->compare;
+  h->compare_r = h1->compare_r;
+  h->compare_arg = h1->compare_arg;
   h->datum_delete = h1->datum_delete;
+  h->block = NULL;
+  h->block_size = 0;
+  h->backend = heap_backend_fibonacci;
+  h->slots = NULL;
+  h->slots_size = 0;
+
+  /* h takes over both pools, since it now holds nodes from each. */
+  if ((c = h->chunks = h1->chunks)) {
+    while (c->next) {
+      c = c->next;
+    }
+    c->next = h2->chunks;
+  } else {
+    h->chunks = h2->chunks;
+  }
+  if ((n = h->free_nodes = h1->free_nodes)) {
+    while (n->next) {
+      n = n->next;
+    }
+    n->next = h2->free_nodes;
+  } else {
+    h->free_nodes = h2->free_nodes;
+  }
+  h->pool.allocations = h1->pool.allocations + h2->pool.allocations;
+  h->pool.nodes = h1->pool.nodes + h2->pool.nodes;
+  h->pool.free = h1->pool.free + h2->pool.free;
 
   if (!h1->min) {
     h->min = h2->min;
@@ -254,9 +594,10 @@ int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
     h->min = h1->min;
     h->size = h1->size;
   } else {
-    h->min = ((h->compare(h1->min->datum, h2->min->datum) < 0) ?
+    h->min = ((heap_compare(h, h1->min->datum, h2->min->datum) < 0) ?
               h1->min                                          :
               h2->min);
+    h->size = h1->size + h2->size;
     splice_heap_node_lists(h1->min, h2->min);
   }
 
@@ -296,7 +637,7 @@ static void heap_cascading_cut(heap_t *h, heap_node_t *n)
 
 int heap_decrease_key(heap_t *h, heap_node_t *n, void *v)
 {
-  if (h->compare(n->datum, v) <= 0) {
+  if (heap_compare(h, n->datum, v) <= 0) {
     return 1;
   }
 
@@ -317,13 +658,18 @@ int heap_decrease_key_no_replace(heap_t *h, heap_node_t *n)
 
   heap_node_t *p;
 
+  if (h->backend == heap_backend_dary) {
+    heap_dary_sift_up(h, n->index);
+    return 0;
+  }
+
   p = n->parent;
 
-  if (p && (h->compare(n->datum, p->datum) < 0)) {
+  if (p && (heap_compare(h, n->datum, p->datum) < 0)) {
     heap_cut(h, n, p);
     heap_cascading_cut(h, p);
   }
-  if (h->compare(n->datum, h->min->datum) < 0) {
+  if (heap_compare(h, n->datum, h->min->datum) < 0) {
     h->min = n;
   }
 
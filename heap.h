@@ -9,21 +9,84 @@ extern "C" {
 
 struct heap_node;
 typedef struct heap_node heap_node_t;
+struct heap_chunk;
+
+/* Two implementations sit behind the same interface.  The Fibonacci   *
+ * heap has the better bounds; the d-ary heap is an implicit heap in an *
+ * array, with each node remembering its slot so that decrease-key can  *
+ * find it, which is kinder to the cache at the sizes we use.  On the   *
+ * game's own call patterns (see heap_bench) the d-ary heap is about    *
+ * twice as fast, so it's the default.  Choose at build time with       *
+ * -DHEAP_DEFAULT_BACKEND=heap_backend_fibonacci, or per heap with      *
+ * heap_set_backend().  The backends may break ties differently.        */
+typedef enum heap_backend {
+  heap_backend_fibonacci,
+  heap_backend_dary
+} heap_backend_t;
+
+# ifndef HEAP_DEFAULT_BACKEND
+#  define HEAP_DEFAULT_BACKEND heap_backend_dary
+# endif
+# define HEAP_DARY_ARITY 4
+
+/* Nodes for heap_insert() come from a free list owned by the heap, which *
+ * grows in chunks and is only returned to the system by heap_delete().   *
+ * Once a heap has reached its working size, inserts and removals never   *
+ * allocate; allocations not moving is how you confirm that.              */
+typedef struct heap_pool_stats {
+  uint32_t allocations; /* Chunks malloc()ed             */
+  uint32_t nodes;       /* Nodes in all of those chunks  */
+  uint32_t free;        /* Nodes on the free list        */
+} heap_pool_stats_t;
 
 typedef struct heap {
   heap_node_t *min;
   uint32_t size;
   int32_t (*compare)(const void *key, const void *with);
+  int32_t (*compare_r)(const void *key, const void *with, void *arg);
+  void *compare_arg;
   void (*datum_delete)(void *);
+  heap_node_t *block;
+  uint32_t block_size;
+  struct heap_chunk *chunks;
+  heap_node_t *free_nodes;
+  heap_pool_stats_t pool;
+  heap_backend_t backend;
+  heap_node_t **slots;
+  uint32_t slots_size;
 } heap_t;
 
 void heap_init(heap_t *h,
                int32_t (*compare)(const void *key, const void *with),
                void (*datum_delete)(void *));
+/* Like heap_init(), but arg is passed through to every call of compare, *
+ * in the manner of qsort_r().  Use this instead of a global when the    *
+ * comparison needs more than the two keys.                              */
+void heap_init_r(heap_t *h,
+                 int32_t (*compare)(const void *key, const void *with,
+                                    void *arg),
+                 void *arg,
+                 void (*datum_delete)(void *));
+/* Only valid on an empty heap; returns non-zero otherwise. */
+int heap_set_backend(heap_t *h, heap_backend_t backend);
 void heap_delete(heap_t *h);
+/* Empties the heap like heap_delete(), but the heap remains initialized *
+ * and keeps its node block for the next heap_build().                   */
+void heap_reset(heap_t *h);
+/* Makes sure at least n nodes are on the free list.  Returns non-zero *
+ * if it runs out of memory.                                           */
+int heap_reserve(heap_t *h, uint32_t n);
 heap_node_t *heap_insert(heap_t *h, void *v);
+/* Inserts v[0..n-1] into an empty heap, taking all of the nodes from a *
+ * single block that the heap keeps until heap_delete().  A Fibonacci   *
+ * heap ends up the same as if they were inserted in order with         *
+ * heap_insert(); a d-ary heap is heapified bottom-up in linear time.   *
+ * If nodes is not NULL, nodes[i] receives the node for v[i].  Returns  *
+ * non-zero if the heap isn't empty or if it runs out of memory.        */
+int heap_build(heap_t *h, void **v, uint32_t n, heap_node_t **nodes);
 void *heap_peek_min(heap_t *h);
 void *heap_remove_min(heap_t *h);
+/* Fibonacci heaps only; fails on d-ary heaps. */
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2);
 int heap_decrease_key(heap_t *h, heap_node_t *n, void *v);
 int heap_decrease_key_no_replace(heap_t *h, heap_node_t *n);
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "heap.h"
+
+/* Compares the heap backends on the call patterns the game actually uses: *
+ * the heap engine's Dijkstra searches from path.cpp (one heap_build() of  *
+ * every open cell, then remove-min and decrease-key until empty), and the *
+ * event loop from move.cpp (a dozen or so events, each turn a remove-min  *
+ * followed by re-inserting the same event later in time).                 *
+ *                                                                         *
+ * Usage: heap_bench [iterations] [seed]                                   */
+
+#define BENCH_X 80
+#define BENCH_Y 21
+
+typedef struct bench_cell {
+  heap_node_t *hn;
+  uint8_t pos[2];
+} bench_cell_t;
+
+typedef struct bench_event {
+  uint32_t time;
+  uint32_t sequence;
+  uint32_t speed;
+} bench_event_t;
+
+static uint8_t open_map[BENCH_Y][BENCH_X];
+static uint8_t hardness[BENCH_Y][BENCH_X];
+
+static int32_t cell_cmp(const void *key, const void *with, void *dist)
+{
+  return (((uint8_t *) dist)[((bench_cell_t *) key)->pos[0] * BENCH_X +
+                             ((bench_cell_t *) key)->pos[1]] -
+          ((uint8_t *) dist)[((bench_cell_t *) with)->pos[0] * BENCH_X +
+                             ((bench_cell_t *) with)->pos[1]]);
+}
+
+static int32_t event_cmp(const void *key, const void *with)
+{
+  int32_t difference;
+
+  difference = (((bench_event_t *) key)->time -
+                ((bench_event_t *) with)->time);
+  return difference ? difference : (((bench_event_t *) key)->sequence -
+                                    ((bench_event_t *) with)->sequence);
+}
+
+static double now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+/* Roughly dungeon-shaped: rooms of open floor joined by open corridors, *
+ * hard rock everywhere else, and an immutable border.                   */
+static void make_map(void)
+{
+  uint32_t i, x, y, x0, y0, w, h;
+
+  for (y = 0; y < BENCH_Y; y++) {
+    for (x = 0; x < BENCH_X; x++) {
+      open_map[y][x] = 0;
+      hardness[y][x] = (!y || !x || y == BENCH_Y - 1 || x == BENCH_X - 1) ?
+                       255 : 1 + rand() % 254;
+    }
+  }
+  for (i = 0; i < 8; i++) {
+    w = 4 + rand() % 11;
+    h = 2 + rand() % 7;
+    x0 = 1 + rand() % (BENCH_X - w - 2);
+    y0 = 1 + rand() % (BENCH_Y - h - 2);
+    for (y = y0; y < y0 + h; y++) {
+      for (x = x0; x < x0 + w; x++) {
+        open_map[y][x] = 1;
+        hardness[y][x] = 0;
+      }
+    }
+  }
+  for (y = BENCH_Y / 2, x = 1; x < BENCH_X - 1; x++) {
+    open_map[y][x] = 1;
+    hardness[y][x] = 0;
+  }
+}
+
+static void dijkstra(heap_t *h, bench_cell_t c[BENCH_Y][BENCH_X],
+                     uint8_t dist[BENCH_Y][BENCH_X], uint32_t tunnel)
+{
+  static void *data[BENCH_Y * BENCH_X];
+  static heap_node_t *nodes[BENCH_Y * BENCH_X];
+  bench_cell_t *p;
+  uint32_t i, n, x, y, cost;
+  int32_t dx, dy;
+
+  memset(dist, 255, BENCH_Y * BENCH_X);
+  dist[BENCH_Y / 2][BENCH_X / 2] = 0;
+
+  for (n = 0, y = 0; y < BENCH_Y; y++) {
+    for (x = 0; x < BENCH_X; x++) {
+      if (tunnel ? hardness[y][x] != 255 : open_map[y][x]) {
+        data[n++] = &c[y][x];
+      } else {
+        c[y][x].hn = NULL;
+      }
+    }
+  }
+  heap_build(h, data, n, nodes);
+  for (i = 0; i < n; i++) {
+    ((bench_cell_t *) data[i])->hn = nodes[i];
+  }
+
+  while ((p = heap_remove_min(h))) {
+    p->hn = NULL;
+    cost = tunnel ? hardness[p->pos[0]][p->pos[1]] / 85 + 1 : 1;
+    for (dy = -1; dy <= 1; dy++) {
+      for (dx = -1; dx <= 1; dx++) {
+        y = p->pos[0] + dy;
+        x = p->pos[1] + dx;
+        if (c[y][x].hn && dist[y][x] > dist[p->pos[0]][p->pos[1]] + cost) {
+          dist[y][x] = dist[p->pos[0]][p->pos[1]] + cost;
+          heap_decrease_key_no_replace(h, c[y][x].hn);
+        }
+      }
+    }
+  }
+  heap_reset(h);
+}
+
+static double bench_path(heap_backend_t backend, uint32_t iterations,
+                         uint32_t tunnel, uint32_t *check)
+{
+  static bench_cell_t c[BENCH_Y][BENCH_X];
+  static uint8_t dist[BENCH_Y][BENCH_X];
+  heap_t h;
+  uint32_t i, x, y;
+  double start;
+
+  for (y = 0; y < BENCH_Y; y++) {
+    for (x = 0; x < BENCH_X; x++) {
+      c[y][x].pos[0] = y;
+      c[y][x].pos[1] = x;
+    }
+  }
+
+  heap_init_r(&h, cell_cmp, dist, NULL);
+  heap_set_backend(&h, backend);
+
+  start = now();
+  for (i = 0; i < iterations; i++) {
+    dijkstra(&h, c, dist, tunnel);
+  }
+  start = now() - start;
+
+  for (*check = 0, y = 0; y < BENCH_Y; y++) {
+    for (x = 0; x < BENCH_X; x++) {
+      *check += dist[y][x];
+    }
+  }
+
+  heap_delete(&h);
+
+  return start / iterations;
+}
+
+static double bench_events(heap_backend_t backend, uint32_t turns,
+                           uint32_t *check)
+{
+  bench_event_t e[13], *p;
+  heap_t h;
+  uint32_t i, sequence;
+  double start;
+
+  heap_init(&h, event_cmp, NULL);
+  heap_set_backend(&h, backend);
+  heap_reserve(&h, sizeof (e) / sizeof (e[0]));
+
+  srand(1);
+  for (sequence = 0, i = 0; i < sizeof (e) / sizeof (e[0]); i++) {
+    e[i].speed = 5 + rand() % 16;
+    e[i].time = 1000 / e[i].speed;
+    e[i].sequence = sequence++;
+    heap_insert(&h, &e[i]);
+  }
+
+  start = now();
+  for (*check = 0, i = 0; i < turns; i++) {
+    p = heap_remove_min(&h);
+    *check += p - e;
+    p->time += 1000 / p->speed;
+    p->sequence = sequence++;
+    heap_insert(&h, p);
+  }
+  start = now() - start;
+
+  heap_delete(&h);
+
+  return start / turns;
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *name[] = { "fibonacci", "4-ary" };
+  static const heap_backend_t backend[] = {
+    heap_backend_fibonacci,
+    heap_backend_dary
+  };
+  uint32_t b, iterations, seed, check[3];
+
+  iterations = argc > 1 ? atoi(argv[1]) : 2000;
+  seed = argc > 2 ? atoi(argv[2]) : 327;
+
+  srand(seed);
+  make_map();
+
+  printf("%-10s %14s %14s %14s\n",
+         "backend", "walk (us)", "tunnel (us)", "event (ns)");
+  for (b = 0; b < sizeof (backend) / sizeof (backend[0]); b++) {
+    printf("%-10s %14.2f %14.2f %14.2f",
+           name[b],
+           bench_path(backend[b], iterations, 0, check + 0) * 1000000.0,
+           bench_path(backend[b], iterations, 1, check + 1) * 1000000.0,
+           bench_events(backend[b], iterations * 1000, check + 2) *
+           1000000000.0);
+    printf("   [%u %u %u]\n", check[0], check[1], check[2]);
+  }
+
+  return 0;
+}
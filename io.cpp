@@ -2,6 +2,7 @@
 #include <ncurses.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <vector>
 
 #include "io.h"
 #include "move.h"
@@ -12,9 +13,6 @@
 #include "object.h"
 #include "npc.h"
 
-/* Same ugly hack we did in path.c */
-static dungeon *the_dungeon;
-
 typedef struct io_message {
   /* Will print " --more-- " at end of line when another message follows. *
    * Leave 10 extra spaces for that.                                      */
@@ -108,6 +106,7 @@ static void io_print_message_queue(uint32_t y, uint32_t x)
 void io_display_tunnel(dungeon *d)
 {
   uint32_t y, x;
+  path_update(d);
   clear();
   for (y = 0; y < DUNGEON_Y; y++) {
     for (x = 0; x < DUNGEON_X; x++) {
@@ -126,6 +125,7 @@ void io_display_tunnel(dungeon *d)
 void io_display_distance(dungeon *d)
 {
   uint32_t y, x;
+  path_update(d);
   clear();
   for (y = 0; y < DUNGEON_Y; y++) {
     for (x = 0; x < DUNGEON_X; x++) {
@@ -164,6 +164,34 @@ void io_display_hardness(dungeon *d)
   refresh();
 }
 
+/* Glyph for a terrain type, the same in every view of the map. */
+static chtype io_terrain_glyph(terrain_type_t t)
+{
+  switch (t) {
+  case ter_wall:
+  case ter_wall_immutable:
+  case ter_unknown:
+    return ' ';
+  case ter_wizard:
+    return '?';
+  case ter_floor:
+  case ter_floor_room:
+    return '.';
+  case ter_floor_hall:
+    return '#';
+  case ter_debug:
+    return '*';
+  case ter_stairs_up:
+    return '<';
+  case ter_stairs_down:
+    return '>';
+  default:
+ /* Use zero as an error symbol, since it stands out somewhat, and it's *
+  * not otherwise used.                                                 */
+    return '0';
+  }
+}
+
 static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
 {
   /* This was initially supposed to only redisplay visible monsters.  After *
@@ -238,47 +266,13 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
                                     [d->PC->position[dim_x] +
                                      pos[dim_x]]->get_color()));
       } else {
-        switch (pc_learned_terrain(d->PC,
-                                   d->PC->position[dim_y] + pos[dim_y],
-                                   d->PC->position[dim_x] +
-                                   pos[dim_x])) {
-        case ter_wall:
-        case ter_wall_immutable:
-        case ter_unknown:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], ' ');
-          break;
-	case ter_wizard:
-	  mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-		  d->PC->position[dim_x] + pos[dim_x], '?');
-	  break;
-	case ter_floor:
-        case ter_floor_room:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '.');
-	  break;
-	case ter_floor_hall:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '#');
-          break;
-        case ter_debug:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '*');
-          break;
-        case ter_stairs_up:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '<');
-          break;
-        case ter_stairs_down:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '>');
-          break;
-        default:
- /* Use zero as an error symbol, since it stands out somewhat, and it's *
-  * not otherwise used.                                                 */
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '0');
-        }
+        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
+                d->PC->position[dim_x] + pos[dim_x],
+                io_terrain_glyph(pc_learned_terrain(d->PC,
+                                                    d->PC->position[dim_y] +
+                                                    pos[dim_y],
+                                                    d->PC->position[dim_x] +
+                                                    pos[dim_x])));
       }
       attroff(A_BOLD);
     }
@@ -287,85 +281,71 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
   refresh();
 }
 
+/* The cell at pos as the PC sees it: glyph, color pair and bold. */
+static chtype io_map_cell(dungeon *d, pair_t pos, uint32_t illuminated)
+{
+  chtype bold = illuminated ? A_BOLD : 0;
+  character *c;
+  object *o;
+
+  if ((c = d->character_map[pos[dim_y]][pos[dim_x]]) &&
+      can_see(d, character_get_pos(d->PC), character_get_pos(c), 1, 0)) {
+    return ((chtype) (unsigned char) character_get_symbol(c) |
+            COLOR_PAIR(c->get_color()) | bold);
+  }
+  if ((o = d->objmap[pos[dim_y]][pos[dim_x]]) &&
+      (o->have_seen() || can_see(d, character_get_pos(d->PC), pos, 1, 0))) {
+    return ((chtype) (unsigned char) o->get_symbol() |
+            COLOR_PAIR(o->get_color()) | bold);
+  }
+
+  return io_terrain_glyph(pc_learned_terrain(d->PC, pos[dim_y],
+                                             pos[dim_x])) | bold;
+}
+
+/* Draws the map by difference.  Each row is composed as curses cells    *
+ * (glyph, color and bold in one chtype) and compared with what stdscr,  *
+ * curses' own copy of the screen, already holds there, and only the     *
+ * runs that differ are written, a run to a call.  Comparing against the *
+ * screen rather than against our last frame means menus and other       *
+ * screens drawn over the map need no bookkeeping: whatever they left is *
+ * simply different.  Nothing here calls clear(), which would make the   *
+ * next refresh() repaint every cell on the terminal; with it gone,      *
+ * refresh() sends only the cells we changed.                            */
 void io_display(dungeon *d)
 {
   pair_t pos;
-  uint32_t illuminated;
-  uint32_t color;
+  bitrow_t lit;
+  chtype frame[DUNGEON_X], screen[DUNGEON_X + 1];
+  int32_t run;
 
-  clear();
   for (pos[dim_y] = 0; pos[dim_y] < DUNGEON_Y; pos[dim_y]++) {
+    lit = pc_lit_row(d->PC, pos[dim_y]);
     for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
-      if ((illuminated = is_illuminated(d->PC,
-                                        pos[dim_y],
-                                        pos[dim_x]))) {
-        attron(A_BOLD);
-      }
-      if (d->character_map[pos[dim_y]]
-                          [pos[dim_x]] &&
-          can_see(d,
-                  character_get_pos(d->PC),
-                  character_get_pos(d->character_map[pos[dim_y]]
-                                                    [pos[dim_x]]), 1, 0)) {
+      frame[pos[dim_x]] = io_map_cell(d, pos, (lit >> pos[dim_x]) & 1);
+    }
 
-        attron(COLOR_PAIR((color = d->character_map[pos[dim_y]]
-                                                   [pos[dim_x]]->get_color())));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
-                character_get_symbol(d->character_map[pos[dim_y]]
-                                                     [pos[dim_x]]));
-        attroff(COLOR_PAIR(color));
-      } else if (d->objmap[pos[dim_y]]
-                          [pos[dim_x]] &&
-                 (d->objmap[pos[dim_y]]
-                           [pos[dim_x]]->have_seen() ||
-                  can_see(d, character_get_pos(d->PC), pos, 1, 0))) {
-        attron(COLOR_PAIR(d->objmap[pos[dim_y]]
-                                   [pos[dim_x]]->get_color()));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
-                d->objmap[pos[dim_y]]
-                         [pos[dim_x]]->get_symbol());
-        attroff(COLOR_PAIR(d->objmap[pos[dim_y]]
-                                    [pos[dim_x]]->get_color()));
+    mvinchnstr(pos[dim_y] + 1, 0, screen, DUNGEON_X);
+    for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x] += run) {
+      for (run = 0;
+           pos[dim_x] + run < DUNGEON_X &&
+             frame[pos[dim_x] + run] != screen[pos[dim_x] + run];
+           run++)
+        ;
+      if (run) {
+        mvaddchnstr(pos[dim_y] + 1, pos[dim_x], frame + pos[dim_x], run);
       } else {
-        switch (pc_learned_terrain(d->PC,
-                                   pos[dim_y],
-                                   pos[dim_x])) {
-        case ter_wall:
-        case ter_wall_immutable:
-        case ter_unknown:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], ' ');
-          break;
-	case ter_wizard:
-	  mvaddch(pos[dim_y] + 1, pos[dim_x], '?');
-	  break;
-        case ter_floor:
-        case ter_floor_room:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '.');
-          break;
-        case ter_floor_hall:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '#');
-          break;
-        case ter_debug:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '*');
-          break;
-        case ter_stairs_up:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '<');
-          break;
-        case ter_stairs_down:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '>');
-          break;
-        default:
- /* Use zero as an error symbol, since it stands out somewhat, and it's *
-  * not otherwise used.                                                 */
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '0');
-        }
-      }
-      if (illuminated) {
-        attroff(A_BOLD);
+        run = 1;
       }
     }
   }
 
+  /* The message line and the status lines below the map. */
+  move(0, 0);
+  clrtoeol();
+  move(DUNGEON_Y + 1, 0);
+  clrtobot();
+
   mvprintw(23, 0, "PC position is (%3d,%2d).",
            character_get_x(d->PC), character_get_y(d->PC));
 
@@ -378,14 +358,14 @@ static void io_redisplay_non_terrain(dungeon *d, pair_t cursor)
 {
   /* For the wiz-mode teleport, in order to see color-changing effects. */
   pair_t pos;
+  bitrow_t lit;
   uint32_t color;
   uint32_t illuminated;
 
   for (pos[dim_y] = 0; pos[dim_y] < DUNGEON_Y; pos[dim_y]++) {
+    lit = pc_lit_row(d->PC, pos[dim_y]);
     for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
-      if ((illuminated = is_illuminated(d->PC,
-                                        pos[dim_y],
-                                        pos[dim_x]))) {
+      if ((illuminated = (lit >> pos[dim_x]) & 1)) {
         attron(A_BOLD);
       }
       if (cursor[dim_y] == pos[dim_y] && cursor[dim_x] == pos[dim_x]) {
@@ -409,6 +389,79 @@ static void io_redisplay_non_terrain(dungeon *d, pair_t cursor)
   refresh();
 }
 
+/* Cells with multi-colored characters that the redisplay above would *
+ * draw, so io_wait_input() can keep them changing color.              */
+static void io_find_animated(dungeon *d, pair_t cursor, uint32_t fog_off,
+                             std::vector<character *> &animated)
+{
+  pair_t pos;
+  character *c;
+
+  for (pos[dim_y] = 0; pos[dim_y] < DUNGEON_Y; pos[dim_y]++) {
+    for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
+      if ((c = d->character_map[pos[dim_y]][pos[dim_x]]) &&
+          c->color.size() > 1 &&
+          (pos[dim_y] != cursor[dim_y] || pos[dim_x] != cursor[dim_x]) &&
+          (fog_off ||
+           (abs(pos[dim_y] - d->PC->position[dim_y]) <= PC_VISUAL_RANGE &&
+            abs(pos[dim_x] - d->PC->position[dim_x]) <= PC_VISUAL_RANGE &&
+            can_see(d, d->PC->position, c->position, 1, 0)))) {
+        animated.push_back(c);
+      }
+    }
+  }
+}
+
+static uint32_t io_key_within(uint32_t usec)
+{
+  fd_set readfs;
+  struct timeval tv;
+
+  FD_ZERO(&readfs);
+  FD_SET(STDIN_FILENO, &readfs);
+
+  tv.tv_sec = 0;
+  tv.tv_usec = usec;
+
+  return select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv);
+}
+
+/* Draws the map's characters and waits for a key.  Nothing changes     *
+ * between keys except the multi-colored characters in view, which take *
+ * a new color every eighth of a second, so only their cells are        *
+ * repainted while waiting, and when there are none, we return at once  *
+ * and let getch() sleep until the player does something.               */
+static void io_wait_input(dungeon *d, pair_t cursor, uint32_t fog_off)
+{
+  std::vector<character *> animated;
+  uint32_t i, color;
+
+  if (fog_off) {
+    /* Out-of-bounds cursor will not be rendered. */
+    io_redisplay_non_terrain(d, cursor);
+  } else {
+    io_redisplay_visible_monsters(d, cursor);
+  }
+
+  io_find_animated(d, cursor, fog_off, animated);
+
+  while (!animated.empty() &&
+         !io_key_within(125000 /* An eigth of a second */)) {
+    for (i = 0; i < animated.size(); i++) {
+      if (is_illuminated(d->PC, animated[i]->position[dim_y],
+                         animated[i]->position[dim_x])) {
+        attron(A_BOLD);
+      }
+      attron(COLOR_PAIR((color = animated[i]->get_color())));
+      mvaddch(animated[i]->position[dim_y] + 1, animated[i]->position[dim_x],
+              character_get_symbol(animated[i]));
+      attroff(COLOR_PAIR(color));
+      attroff(A_BOLD);
+    }
+    refresh();
+  }
+}
+
 void io_display_no_fog(dungeon *d)
 {
   uint32_t y, x;
@@ -426,35 +479,7 @@ void io_display_no_fog(dungeon *d)
         mvaddch(y + 1, x, d->objmap[y][x]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[y][x]->get_color()));
       } else {
-        switch (mapxy(x, y)) {
-        case ter_wall:
-        case ter_wall_immutable:
-          mvaddch(y + 1, x, ' ');
-          break;
-	case ter_wizard:
-	  mvaddch(y + 1, x, '?');
-	  break;
-        case ter_floor:
-        case ter_floor_room:
-          mvaddch(y + 1, x, '.');
-          break;
-        case ter_floor_hall:
-          mvaddch(y + 1, x, '#');
-          break;
-        case ter_debug:
-          mvaddch(y + 1, x, '*');
-          break;
-        case ter_stairs_up:
-          mvaddch(y + 1, x, '<');
-          break;
-        case ter_stairs_down:
-          mvaddch(y + 1, x, '>');
-          break;
-        default:
- /* Use zero as an error symbol, since it stands out somewhat, and it's *
-  * not otherwise used.                                                 */
-          mvaddch(y + 1, x, '0');
-        }
+        mvaddch(y + 1, x, io_terrain_glyph(mapxy(x, y)));
       }
     }
   }
@@ -481,8 +506,6 @@ uint32_t io_teleport_pc(dungeon *d)
 {
   pair_t dest;
   int c;
-  fd_set readfs;
-  struct timeval tv;
 
   io_display_no_fog(d);
 
@@ -495,48 +518,11 @@ uint32_t io_teleport_pc(dungeon *d)
   refresh();
 
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      io_redisplay_non_terrain(d, dest);
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, dest, 1);
     /* Can simply draw the terrain when we move the cursor away, *
      * because if it is a character or object, the refresh       *
      * function will fix it for us.                              */
-    switch (mappair(dest)) {
-    case ter_wall:
-    case ter_wall_immutable:
-    case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
-      break;
-    case ter_floor:
-    case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
-      break;
-    case ter_wizard:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '?');
-      break;
-    case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
-      break;
-    case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
-      break;
-    case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
-      break;
-    case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
-      break;
-    default:
- /* Use zero as an error symbol, since it stands out somewhat, and it's *
-  * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
-    }
+    mvaddch(dest[dim_y] + 1, dest[dim_x], io_terrain_glyph(mappair(dest)));
     switch ((c = getch())) {
     case '7':
     case 'y':
@@ -627,8 +613,7 @@ uint32_t io_teleport_pc(dungeon *d)
   }
 
   pc_observe_terrain(d->PC, d);
-  dijkstra(d);
-  dijkstra_tunnel(d);
+  path_invalidate(d);
 
   io_display(d);
 
@@ -754,15 +739,14 @@ static void io_list_monsters_display(dungeon *d,
   free(s);
 }
 
-static int compare_monster_distance(const void *v1, const void *v2)
+static int compare_monster_distance(const void *v1, const void *v2, void *v)
 {
   const character *const *c1 = (const character *const *) v1;
   const character *const *c2 = (const character *const *) v2;
+  const dungeon *d = (const dungeon *) v;
 
-  return (the_dungeon->pc_distance[(*c1)->position[dim_y]]
-                                  [(*c1)->position[dim_x]] -
-          the_dungeon->pc_distance[(*c2)->position[dim_y]]
-                                  [(*c2)->position[dim_x]]);
+  return (d->pc_distance[(*c1)->position[dim_y]][(*c1)->position[dim_x]] -
+          d->pc_distance[(*c2)->position[dim_y]][(*c2)->position[dim_x]]);
 }
 
 static void io_list_monsters(dungeon *d)
@@ -784,8 +768,8 @@ static void io_list_monsters(dungeon *d)
   }
 
   /* Sort it by distance from PC */
-  the_dungeon = d;
-  qsort(c, count, sizeof (*c), compare_monster_distance);
+  path_update(d);
+  qsort_r(c, count, sizeof (*c), compare_monster_distance, d);
 
   /* Display it */
   io_list_monsters_display(d, c, count);
@@ -806,6 +790,42 @@ void io_display_ch(dungeon_t *d)
   io_display(d);
 }
 
+void io_display_stats(dungeon_t *d)
+{
+  mvprintw(4, 22, " %-34s ", "");
+  mvprintw(5, 22, " Map changes reported:     %8u ",
+           d->path_stats.invalidations);
+  mvprintw(6, 22, " Full map recomputes:      %8u ",
+           d->path_stats.recomputes);
+  mvprintw(7, 22, " Incremental map repairs:  %8u ",
+           d->path_stats.repairs);
+  mvprintw(8, 22, " Map cache hits:           %8u ",
+           d->path_stats.cache_hits);
+  mvprintw(9, 22, " Map cache hit rate:       %7u%% ",
+           path_cache_hit_rate(&d->path_stats));
+  mvprintw(10, 22, " Target maps built:        %8u ",
+           d->path_stats.target_builds);
+  mvprintw(11, 22, " Recomputes avoided:       %8u ",
+           path_recomputes_avoided(&d->path_stats));
+  mvprintw(12, 22, " %-34s ", "");
+  mvprintw(13, 22, " Sight cache hits:         %8u ",
+           los_cache_stats(d)->hits);
+  mvprintw(14, 22, " Sight cache misses:       %8u ",
+           los_cache_stats(d)->misses);
+  mvprintw(15, 22, " %-34s ", "");
+  mvprintw(16, 22, " Event queue pool nodes:   %8u ",
+           d->events.pool.nodes);
+  mvprintw(17, 22, " Event queue pool free:    %8u ",
+           d->events.pool.free);
+  mvprintw(18, 22, " Event queue allocations:  %8u ",
+           d->events.pool.allocations);
+  mvprintw(19, 22, " %-34s ", "");
+  mvprintw(20, 22, " %-34s ", "Hit any key to continue.");
+  refresh();
+  getch();
+  io_display(d);
+}
+
 void io_object_to_string(object *o, char *s, uint32_t size)
 {
   if (o) {
@@ -1107,8 +1127,6 @@ static uint32_t io_inspect_monster(dungeon_t *d)
   uint32_t n, cont;
   pair_t dest, tmp;
   int c;
-  fd_set readfs;
-  struct timeval tv;
   char s[80];
   const char *p;
 
@@ -1123,45 +1141,11 @@ static uint32_t io_inspect_monster(dungeon_t *d)
   refresh();
 
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      io_redisplay_visible_monsters(d, dest);
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, dest, 0);
     /* Can simply draw the terrain when we move the cursor away, *
      * because if it is a character or object, the refresh       *
      * function will fix it for us.                              */
-    switch (mappair(dest)) {
-    case ter_wall:
-    case ter_wall_immutable:
-    case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
-      break;
-    case ter_floor:
-    case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
-      break;
-    case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
-      break;
-    case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
-      break;
-    case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
-      break;
-    case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
-      break;
-    default:
- /* Use zero as an error symbol, since it stands out somewhat, and it's *
-  * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
-    }
+    mvaddch(dest[dim_y] + 1, dest[dim_x], io_terrain_glyph(mappair(dest)));
     tmp[dim_y] = dest[dim_y];
     tmp[dim_x] = dest[dim_x];
     switch ((c = getch())) {
@@ -1416,28 +1400,13 @@ void io_talk(dungeon *d)
 {
   uint32_t fail_code;
   int key;
-  fd_set readfs;
-  struct timeval tv;
   uint32_t fog_off = 0;
   pair_t tmp = { DUNGEON_X, DUNGEON_Y };
   
   //io_queue_message("Enter a direction to talk to an NPC");
   mvprintw(0, 0, "Enter a direction to talk to an NPC, Escape to quit");
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      if (fog_off) {
-        /* Out-of-bounds cursor will not be rendered. */
-        io_redisplay_non_terrain(d, tmp);
-      } else {
-        io_redisplay_visible_monsters(d, tmp);
-      }
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, tmp, fog_off);
     fog_off = 0;
     switch (key = getch()) {
     case '7':
@@ -1504,28 +1473,13 @@ void io_push(dungeon *d)
 {
   uint32_t fail_code;
   int key;
-  fd_set readfs;
-  struct timeval tv;
   uint32_t fog_off = 0;
   pair_t tmp = { DUNGEON_X, DUNGEON_Y };
   
   //io_queue_message("Enter a direction to talk to an NPC");
   mvprintw(0, 0, "Enter a direction to switch places with an ally, Escape to quit");
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      if (fog_off) {
-        /* Out-of-bounds cursor will not be rendered. */
-        io_redisplay_non_terrain(d, tmp);
-      } else {
-        io_redisplay_visible_monsters(d, tmp);
-      }
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, tmp, fog_off);
     fog_off = 0;
     switch (key = getch()) {
     case '7':
@@ -1592,26 +1546,11 @@ void io_handle_input(dungeon *d)
 {
   uint32_t fail_code;
   int key;
-  fd_set readfs;
-  struct timeval tv;
   uint32_t fog_off = 0;
   pair_t tmp = { DUNGEON_X, DUNGEON_Y };
 
   do {
-    do{
-      FD_ZERO(&readfs);
-      FD_SET(STDIN_FILENO, &readfs);
-
-      tv.tv_sec = 0;
-      tv.tv_usec = 125000; /* An eigth of a second */
-
-      if (fog_off) {
-        /* Out-of-bounds cursor will not be rendered. */
-        io_redisplay_non_terrain(d, tmp);
-      } else {
-        io_redisplay_visible_monsters(d, tmp);
-      }
-    } while (!select(STDIN_FILENO + 1, &readfs, NULL, NULL, &tv));
+    io_wait_input(d, tmp, fog_off);
     fog_off = 0;
     switch (key = getch()) {
     case '7':
@@ -1729,6 +1668,11 @@ void io_handle_input(dungeon *d)
       io_display_ch(d);
       fail_code = 1;
       break;
+    case 'P':
+      /* Performance counters. */
+      io_display_stats(d);
+      fail_code = 1;
+      break;
     case 'I':
       io_inspect_in(d);
       fail_code = 1;
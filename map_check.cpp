@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dungeon.h"
+#include "character.h"
+#include "pc.h"
+#include "path.h"
+#include "bitboard.h"
+
+/* Checks the shortcuts the game takes with its maps against the slow,    *
+ * obvious way of getting the same answer, on a run of generated levels   *
+ * and on PGM maps, both the ones in images/ and random ones:             *
+ *                                                                        *
+ *   repair - distance maps patched or restored from the cache by         *
+ *            path_update() as monsters dig and soften rock and the PC    *
+ *            moves around, vs. a full dijkstra() and dijkstra_tunnel()   *
+ *   engine - the bucket and sweep engines' dijkstra() and                *
+ *            dijkstra_fields() vs. the heap engine's Dijkstra, on the    *
+ *            generated level and then on random mazes                    *
+ *   room   - room_id and pc_in_room() vs. a scan of the room list        *
+ *   los    - can_see(), answered from its cache, vs. a Bresenham walk    *
+ *            over the map, as random walls around the viewers come down  *
+ *   sight  - can_see_pc() vs. can_see() from every cell around the PC,   *
+ *            rock included, before and after some digging nearby, on     *
+ *            the generated level and then on random mazes                *
+ *                                                                        *
+ * Prints a line per check and exits nonzero if any of them failed.       *
+ *                                                                        *
+ * Usage: map_check [levels] [seed]                                       */
+
+typedef enum check {
+  check_repair,
+  check_engine,
+  check_room,
+  check_los,
+  check_sight,
+  num_checks
+} check_t;
+
+static const char *check_name[num_checks] = {
+  "repair",
+  "engine",
+  "room",
+  "los",
+  "sight"
+};
+
+static uint32_t checked[num_checks], failed[num_checks];
+
+static void expect(check_t c, uint32_t ok, const char *map, const char *what)
+{
+  checked[c]++;
+  if (!ok && !failed[c]++) {
+    fprintf(stderr, "%s: %s: %s\n", check_name[c], map, what);
+  }
+}
+
+static void random_cell(pair_t p)
+{
+  p[dim_y] = 1 + rand() % (DUNGEON_Y - 2);
+  p[dim_x] = 1 + rand() % (DUNGEON_X - 2);
+}
+
+static void random_open(dungeon_t *d, pair_t p)
+{
+  do {
+    random_cell(p);
+  } while (mappair(p) < ter_floor);
+}
+
+static void random_rock(dungeon_t *d, pair_t p)
+{
+  do {
+    random_cell(p);
+  } while (mappair(p) != ter_wall);
+}
+
+/* Digs the way a tunneling monster does in npc.cpp. */
+static void dig(dungeon_t *d, pair_t p)
+{
+  if (hardnesspair(p) <= 85) {
+    hardnesspair(p) = 0;
+    mappair(p) = ter_floor_hall;
+    path_cell_opened(d, p);
+  } else {
+    hardnesspair(p) -= 85;
+    path_cell_softened(d, p);
+  }
+}
+
+static void check_path_repair(dungeon_t *d, const char *map)
+{
+  uint8_t distance[DUNGEON_Y][DUNGEON_X];
+  uint8_t tunnel[DUNGEON_Y][DUNGEON_X];
+  pair_t p, spot[3];
+  uint32_t i, n;
+
+  for (i = 0; i < sizeof (spot) / sizeof (spot[0]); i++) {
+    random_open(d, spot[i]);
+  }
+  random_open(d, d->PC->position);
+  path_invalidate(d);
+  path_update(d);
+
+  for (i = 0; i < 30; i++) {
+    /* Pacing between a few spots sends path_update() to the cache. */
+    if (rand() & 1) {
+      n = rand() % (sizeof (spot) / sizeof (spot[0]));
+      d->PC->position[dim_y] = spot[n][dim_y];
+      d->PC->position[dim_x] = spot[n][dim_x];
+      path_invalidate(d);
+    }
+    /* Some batches overflow the pending list and fall back to a *
+     * full recompute, which has to agree just the same.          */
+    for (n = 1 + rand() % (PATH_MAX_PENDING_REPAIRS + 4); n; n--) {
+      random_rock(d, p);
+      dig(d, p);
+    }
+    path_update(d);
+
+    memcpy(distance, d->pc_distance, sizeof (distance));
+    memcpy(tunnel, d->pc_tunnel, sizeof (tunnel));
+    dijkstra(d);
+    dijkstra_tunnel(d);
+    expect(check_repair, !memcmp(distance, d->pc_distance, sizeof (distance)),
+           map, "walking map differs from recompute");
+    expect(check_repair, !memcmp(tunnel, d->pc_tunnel, sizeof (tunnel)),
+           map, "tunneling map differs from recompute");
+  }
+}
+
+static void check_engines(dungeon_t *d, const char *map)
+{
+  static const path_engine_t engine[] = {
+    path_engine_bucket,
+    path_engine_sweep
+  };
+  uint8_t distance[DUNGEON_Y][DUNGEON_X];
+  uint8_t tunnel[DUNGEON_Y][DUNGEON_X];
+  path_engine_t saved;
+  uint32_t e;
+
+  saved = path_get_engine();
+
+  path_set_engine(path_engine_heap);
+  dijkstra(d);
+  dijkstra_tunnel(d);
+  memcpy(distance, d->pc_distance, sizeof (distance));
+  memcpy(tunnel, d->pc_tunnel, sizeof (tunnel));
+
+  for (e = 0; e < sizeof (engine) / sizeof (engine[0]); e++) {
+    path_set_engine(engine[e]);
+
+    memset(d->pc_distance, 0, sizeof (d->pc_distance));
+    dijkstra(d);
+    expect(check_engine, !memcmp(distance, d->pc_distance, sizeof (distance)),
+           map, "dijkstra() differs from the heap engine");
+
+    memset(d->pc_distance, 0, sizeof (d->pc_distance));
+    memset(d->pc_tunnel, 0, sizeof (d->pc_tunnel));
+    dijkstra_fields(d);
+    expect(check_engine, !memcmp(distance, d->pc_distance, sizeof (distance)),
+           map, "dijkstra_fields() walking map differs from the heap engine");
+    expect(check_engine, !memcmp(tunnel, d->pc_tunnel, sizeof (tunnel)),
+           map, "dijkstra_fields() tunneling map differs from the heap engine");
+  }
+
+  path_set_engine(saved);
+}
+
+/* can_see() the long way: a line drawn from scratch over the map. */
+static uint32_t walk_line(dungeon_t *d, pair_t from, pair_t to,
+                          int32_t range)
+{
+  int32_t del[2], f[2], a, b, c, i, major, minor;
+  pair_t p;
+
+  for (i = 0; i < 2; i++) {
+    del[i] = abs(to[i] - from[i]);
+    f[i] = to[i] > from[i] ? 1 : -1;
+    p[i] = from[i];
+  }
+  if (del[dim_x] > range || del[dim_y] > range) {
+    return 0;
+  }
+
+  major = del[dim_x] > del[dim_y] ? dim_x : dim_y;
+  minor = major == dim_x ? dim_y : dim_x;
+  a = del[minor] + del[minor];
+  c = a - del[major];
+  b = c - del[major];
+  for (i = 0; i <= del[major]; i++) {
+    if (i && i != del[major] &&
+        mappair(p) < ter_floor && mappair(p) != ter_wizard) {
+      return 0;
+    }
+    p[major] += f[major];
+    if (c < 0) {
+      c += a;
+    } else {
+      c += b;
+      p[minor] += f[minor];
+    }
+  }
+
+  return 1;
+}
+
+static void check_lines_of_sight(dungeon_t *d, const char *map)
+{
+  pair_t viewer[4], p, e;
+  uint32_t hits, i, n, v;
+  int32_t is_pc, range;
+
+  for (v = 0; v < sizeof (viewer) / sizeof (viewer[0]); v++) {
+    random_cell(viewer[v]);
+  }
+  hits = los_cache_stats(d)->hits;
+
+  for (n = 0; n < 10; n++) {
+    is_pc = n & 1;
+    range = is_pc ? PC_VISUAL_RANGE : NPC_VISUAL_RANGE;
+    for (v = 0; v < sizeof (viewer) / sizeof (viewer[0]); v++) {
+      for (e[dim_y] = viewer[v][dim_y] - range;
+           e[dim_y] <= viewer[v][dim_y] + range; e[dim_y]++) {
+        for (e[dim_x] = viewer[v][dim_x] - range;
+             e[dim_x] <= viewer[v][dim_x] + range; e[dim_x]++) {
+          if (e[dim_y] < 0 || e[dim_y] >= DUNGEON_Y ||
+              e[dim_x] < 0 || e[dim_x] >= DUNGEON_X) {
+            continue;
+          }
+          expect(check_los, can_see(d, viewer[v], e, is_pc, 0) ==
+                            walk_line(d, viewer[v], e, range),
+                 map, "can_see() differs from a Bresenham walk");
+        }
+      }
+    }
+
+    /* The PC's lines are among the monsters' and come from the cache; *
+     * walls that come down in view after them have to clear it.       */
+    for (i = is_pc ? 1 + rand() % 4 : 0; i; i--) {
+      v = rand() % (sizeof (viewer) / sizeof (viewer[0]));
+      do {
+        random_rock(d, p);
+      } while (abs(p[dim_y] - viewer[v][dim_y]) > NPC_VISUAL_RANGE ||
+               abs(p[dim_x] - viewer[v][dim_x]) > NPC_VISUAL_RANGE);
+      hardnesspair(p) = 1;
+      dig(d, p);
+    }
+  }
+
+  expect(check_los, los_cache_stats(d)->hits != hits,
+         map, "can_see() never answered from its cache");
+}
+
+static void check_pc_sight(dungeon_t *d, const char *map)
+{
+  pair_t p, v;
+  uint32_t i, n;
+
+  for (n = 0; n < 5; n++) {
+    random_open(d, d->PC->position);
+    for (i = 0; i < 2; i++) {
+      for (v[dim_y] = 0; v[dim_y] < DUNGEON_Y; v[dim_y]++) {
+        for (v[dim_x] = 0; v[dim_x] < DUNGEON_X; v[dim_x]++) {
+          expect(check_sight,
+                 can_see_pc(d, v) == can_see(d, v, d->PC->position, 0, 0),
+                 map, "can_see_pc() differs from can_see()");
+        }
+      }
+      /* The field has to notice walls coming down around the PC. */
+      do {
+        random_rock(d, p);
+      } while (abs(p[dim_y] - d->PC->position[dim_y]) > NPC_VISUAL_RANGE ||
+               abs(p[dim_x] - d->PC->position[dim_x]) > NPC_VISUAL_RANGE);
+      hardnesspair(p) = 1;
+      dig(d, p);
+    }
+  }
+}
+
+/* Open cells scattered at random, dense enough to leave long, winding *
+ * corridors and sealed-off pockets.  Leaves the level unplayable.     */
+static void make_maze(dungeon_t *d)
+{
+  uint32_t x, y;
+
+  for (y = 1; y < DUNGEON_Y - 1; y++) {
+    for (x = 1; x < DUNGEON_X - 1; x++) {
+      if (rand() % 100 < 62) {
+        d->map[y][x] = ter_floor_hall;
+        d->hardness[y][x] = 0;
+      } else {
+        d->map[y][x] = ter_wall;
+        d->hardness[y][x] = 1 + rand() % 254;
+      }
+    }
+  }
+  bitboard_build(d);
+}
+
+static void check_rooms(dungeon_t *d, const char *map)
+{
+  uint32_t i, in;
+  int32_t x, y;
+
+  for (y = 0; y < DUNGEON_Y; y++) {
+    for (x = 0; x < DUNGEON_X; x++) {
+      for (in = 0, i = 0; !in && i < d->num_rooms; i++) {
+        if (x >= d->rooms[i].position[dim_x] &&
+            x < d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] &&
+            y >= d->rooms[i].position[dim_y] &&
+            y < d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y]) {
+          in = i + 1;
+        }
+      }
+      expect(check_room, d->room_id[y][x] == in,
+             map, "room_id differs from a scan of the rooms");
+
+      d->PC->position[dim_y] = y;
+      d->PC->position[dim_x] = x;
+      for (i = 0; i < d->num_rooms; i++) {
+        expect(check_room, !pc_in_room(d, i) == (in != i + 1),
+               map, "pc_in_room() differs from a scan of the rooms");
+      }
+    }
+  }
+}
+
+/* Rooms are single pixels in a PGM, so a random one gives hundreds of *
+ * them, many touching each other.                                     */
+static void write_random_pgm(const char *pgm)
+{
+  FILE *f;
+  uint32_t i, r;
+
+  if (!(f = fopen(pgm, "w"))) {
+    perror(pgm);
+    exit(1);
+  }
+  fprintf(f, "P5\n# map_check\n%d %d\n255\n", DUNGEON_X - 2, DUNGEON_Y - 2);
+  for (i = 0; i < (DUNGEON_X - 2) * (DUNGEON_Y - 2); i++) {
+    r = rand() % 100;
+    fputc(r < 15 ? 0 : r < 50 ? 255 : 1 + rand() % 254, f);
+  }
+  fclose(f);
+}
+
+static void check_pgm(dungeon_t *d, const char *pgm, const char *map)
+{
+  init_dungeon(d);
+  read_pgm(d, (char *) pgm);
+  check_rooms(d, map);
+  delete_dungeon(d);
+}
+
+int main(int argc, char *argv[])
+{
+  static dungeon_t d;
+  static const char *image[] = {
+    "images/adventure.pgm",
+    "images/hello.pgm",
+    "images/welldone.pgm"
+  };
+  char map[80], pgm[] = "/tmp/map_checkXXXXXX";
+  uint32_t c, i, level, levels, seed, status;
+  int fd;
+
+  levels = argc > 1 ? atoi(argv[1]) : 100;
+  seed = argc > 2 ? atoi(argv[2]) : 327;
+
+  d.PC = new pc;
+
+  for (level = 0; level < levels; level++) {
+    srand(seed + level);
+    init_dungeon(&d);
+    gen_dungeon(&d);
+    snprintf(map, sizeof (map), "level %u", level);
+    check_rooms(&d, map);
+    check_path_repair(&d, map);
+    for (i = 0; i < 10; i++) {
+      random_open(&d, d.PC->position);
+      check_engines(&d, map);
+    }
+    check_lines_of_sight(&d, map);
+    check_pc_sight(&d, map);
+    make_maze(&d);
+    for (i = 0; i < 10; i++) {
+      random_open(&d, d.PC->position);
+      check_engines(&d, map);
+    }
+    check_lines_of_sight(&d, map);
+    check_pc_sight(&d, map);
+    delete_dungeon(&d);
+  }
+
+  /* read_pgm() gives up on the whole program if it can't open a file. */
+  for (i = 0; i < sizeof (image) / sizeof (image[0]); i++) {
+    if (access(image[i], R_OK)) {
+      perror(image[i]);
+      continue;
+    }
+    check_pgm(&d, image[i], image[i]);
+  }
+
+  if ((fd = mkstemp(pgm)) < 0) {
+    perror(pgm);
+    return 1;
+  }
+  close(fd);
+  for (i = 0; i < levels / 10 + 1; i++) {
+    write_random_pgm(pgm);
+    snprintf(map, sizeof (map), "random pgm %u", i);
+    check_pgm(&d, pgm, map);
+  }
+  unlink(pgm);
+
+  los_cache_delete(d.los);
+  delete d.PC;
+
+  for (status = 0, c = 0; c < num_checks; c++) {
+    printf("%-8s %10u checks %10u failed\n",
+           check_name[c], checked[c], failed[c]);
+    status |= failed[c];
+  }
+
+  return !!status;
+}
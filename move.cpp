@@ -153,6 +153,17 @@ void do_combat(dungeon_t *d, character *atk, character *def)
 			     0, 0, 0, 0, 0, 0, 0, false, objpair(def->position)); 
       o->set_value(def->wealth);
       objpair(def->position) = o;
+      if (def != d->PC && ((npc *) def)->carried) {
+        /* Drop everything it picked up under the gold. */
+        o = ((npc *) def)->carried;
+        while (o->get_next()) {
+          o = o->get_next();
+        }
+        o->set_next(objpair(def->position)->get_next());
+        objpair(def->position)->set_next(((npc *) def)->carried);
+        ((npc *) def)->carried = NULL;
+      }
+      path_targets_changed(d, path_target_objects);
       
       charpair(def->position) = NULL;
     } else {
@@ -214,7 +225,8 @@ OP       * find an empty one for the displacement.                  */
           }
         } else {
           if ((!charpair(displacement) &&
-               (mappair(displacement) >= ter_floor)) ||
+               bitboard_test(d->passable, displacement[dim_y],
+                             displacement[dim_x])) ||
               (charpair(displacement) == c)) {
             found_cell = 1;
           }
@@ -342,34 +354,27 @@ void dir_nearest_wall(dungeon_t *d, character *c, pair_t dir)
   }
 }
 
+/* How many of the four cells orthogonal to c are immutable walls: its *
+ * neighbors in the row, masked out of the row's bits, plus the cells  *
+ * above and below.                                                    */
+static uint32_t immutable_neighbors(dungeon_t *d, character *c)
+{
+  return (bitrow_count((d->immutable[c->position[dim_y]] >>
+                        (c->position[dim_x] - 1)) & 5)               +
+          bitboard_test(d->immutable, c->position[dim_y] - 1,
+                        c->position[dim_x])                          +
+          bitboard_test(d->immutable, c->position[dim_y] + 1,
+                        c->position[dim_x]));
+}
+
 uint32_t against_wall(dungeon_t *d, character *c)
 {
-  return ((mapxy(c->position[dim_x] - 1,
-                 c->position[dim_y]    ) == ter_wall_immutable) ||
-          (mapxy(c->position[dim_x] + 1,
-                 c->position[dim_y]    ) == ter_wall_immutable) ||
-          (mapxy(c->position[dim_x]    ,
-                 c->position[dim_y] - 1) == ter_wall_immutable) ||
-          (mapxy(c->position[dim_x]    ,
-                 c->position[dim_y] + 1) == ter_wall_immutable));
+  return immutable_neighbors(d, c) > 0;
 }
 
 uint32_t in_corner(dungeon_t *d, character *c)
 {
-  uint32_t num_immutable;
-
-  num_immutable = 0;
-
-  num_immutable += (mapxy(c->position[dim_x] - 1,
-                          c->position[dim_y]    ) == ter_wall_immutable);
-  num_immutable += (mapxy(c->position[dim_x] + 1,
-                          c->position[dim_y]    ) == ter_wall_immutable);
-  num_immutable += (mapxy(c->position[dim_x]    ,
-                          c->position[dim_y] - 1) == ter_wall_immutable);
-  num_immutable += (mapxy(c->position[dim_x]    ,
-                          c->position[dim_y] + 1) == ter_wall_immutable);
-
-  return num_immutable > 1;
+  return immutable_neighbors(d, c) > 1;
 }
 
 static void new_dungeon_level(dungeon_t *d, uint32_t dir)
@@ -446,10 +451,14 @@ uint32_t move_pc(dungeon_t *d, uint32_t dir)
     return 0;
   }
 
-  if ((dir != '>') && (dir != '<') && (mappair(next) >= ter_floor)) {
+  if ((dir != '>') && (dir != '<') &&
+      bitboard_test(d->passable, next[dim_y], next[dim_x])) {
     move_character(d, d->PC, next);
-    dijkstra(d);
-    dijkstra_tunnel(d);
+    /* Attacking doesn't move the PC, so the maps are still good. */
+    if ((d->PC->position[dim_y] == next[dim_y]) &&
+        (d->PC->position[dim_x] == next[dim_x])) {
+      path_invalidate(d);
+    }
     d->PC->pick_up(d);
     d->PC->check_gold(d);
     return 0;
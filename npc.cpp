@@ -6,8 +6,11 @@
 #include "character.h"
 #include "move.h"
 #include "path.h"
+#include "relax.h"
 #include "event.h"
 #include "pc.h"
+#include "object.h"
+#include "io.h"
 
 static uint32_t max_monster_cells(dungeon *d)
 {
@@ -72,14 +75,14 @@ void npc_next_pos_rand_tunnel(dungeon *d, character *c, pair_t next)
       mappair(n) = ter_floor_hall;
 
       /* Update distance maps because map has changed. */
-      dijkstra(d);
-      dijkstra_tunnel(d);
+      path_cell_opened(d, n);
     }
 
     next[dim_x] = n[dim_x];
     next[dim_y] = n[dim_y];
   } else {
     hardnesspair(n) -= 85;
+    path_cell_softened(d, n);
   }
 }
 
@@ -109,7 +112,7 @@ void npc_next_pos_rand(dungeon *d, character *c, pair_t next)
         n[dim_x]++;
       }
     }
-  } while (mappair(n) < ter_floor);
+  } while (!bitboard_test(d->passable, n[dim_y], n[dim_x]));
 
   next[dim_y] = n[dim_y];
   next[dim_x] = n[dim_x];
@@ -165,13 +168,15 @@ void npc_next_pos_line_of_sight(dungeon *d, character *c, pair_t next)
     next[dim_x] += dir[dim_x];
     next[dim_y] += dir[dim_y];
   } else {
-    if (mapxy(next[dim_x] + dir[dim_x],
-              next[dim_y] + dir[dim_y]) >= ter_floor) {
+    if (bitboard_test(d->passable, next[dim_y] + dir[dim_y],
+                      next[dim_x] + dir[dim_x])) {
       next[dim_x] += dir[dim_x];
       next[dim_y] += dir[dim_y];
-    } else if (mapxy(next[dim_x] + dir[dim_x], next[dim_y]) >= ter_floor) {
+    } else if (bitboard_test(d->passable, next[dim_y],
+                             next[dim_x] + dir[dim_x])) {
       next[dim_x] += dir[dim_x];
-    } else if (mapxy(next[dim_x], next[dim_y] + dir[dim_y]) >= ter_floor) {
+    } else if (bitboard_test(d->passable, next[dim_y] + dir[dim_y],
+                             next[dim_x])) {
       next[dim_y] += dir[dim_y];
     }
   }
@@ -202,76 +207,41 @@ void npc_next_pos_line_of_sight_tunnel(dungeon *d,
 	mappair(dir) = ter_floor_hall;
 	
 	/* Update distance maps because map has changed. */
-	dijkstra(d);
-	dijkstra_tunnel(d);
+	path_cell_opened(d, dir);
       }
       
       next[dim_x] = dir[dim_x];
       next[dim_y] = dir[dim_y];
     } else {
       hardnesspair(dir) -= 60;
+      path_cell_softened(d, dir);
     }
   }
 }
 
+/* Tunneling monsters add hardness / 60 to the gradient, roughly the *
+ * turns they'd spend digging to get there.                           */
+static constexpr hardness_lut gradient_dig_lut(60, 0);
+
 void npc_next_pos_gradient(dungeon *d, npc *c, pair_t next)
 {
   /* Handles both tunneling and non-tunneling versions */
   pair_t min_next;
-  uint16_t min_cost;
+  uint16_t min_cost, cost;
+  uint32_t i, x, y;
+
+  path_update(d);
+
   if (c->characteristics & NPC_TUNNEL) {
-    min_cost = (d->pc_tunnel[next[dim_y] - 1][next[dim_x]] +
-                (d->hardness[next[dim_y] - 1][next[dim_x]] / 60));
-    min_next[dim_x] = next[dim_x];
-    min_next[dim_y] = next[dim_y] - 1;
-    if ((d->pc_tunnel[next[dim_y] + 1][next[dim_x]    ] +
-         (d->hardness[next[dim_y] + 1][next[dim_x]] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y] + 1][next[dim_x]] +
-                  (d->hardness[next[dim_y] + 1][next[dim_x]] / 60));
-      min_next[dim_x] = next[dim_x];
-      min_next[dim_y] = next[dim_y] + 1;
-    }
-    if ((d->pc_tunnel[next[dim_y]    ][next[dim_x] + 1] +
-         (d->hardness[next[dim_y]    ][next[dim_x] + 1] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y]][next[dim_x] + 1] +
-                  (d->hardness[next[dim_y]][next[dim_x] + 1] / 60));
-      min_next[dim_x] = next[dim_x] + 1;
-      min_next[dim_y] = next[dim_y];
-    }
-    if ((d->pc_tunnel[next[dim_y]    ][next[dim_x] - 1] +
-         (d->hardness[next[dim_y]    ][next[dim_x] - 1] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y]][next[dim_x] - 1] +
-                  (d->hardness[next[dim_y]][next[dim_x] - 1] / 60));
-      min_next[dim_x] = next[dim_x] - 1;
-      min_next[dim_y] = next[dim_y];
-    }
-    if ((d->pc_tunnel[next[dim_y] - 1][next[dim_x] + 1] +
-         (d->hardness[next[dim_y] - 1][next[dim_x] + 1] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y] - 1][next[dim_x] + 1] +
-                  (d->hardness[next[dim_y] - 1][next[dim_x] + 1] / 60));
-      min_next[dim_x] = next[dim_x] + 1;
-      min_next[dim_y] = next[dim_y] - 1;
-    }
-    if ((d->pc_tunnel[next[dim_y] + 1][next[dim_x] + 1] +
-         (d->hardness[next[dim_y] + 1][next[dim_x] + 1] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y] + 1][next[dim_x] + 1] +
-                  (d->hardness[next[dim_y] + 1][next[dim_x] + 1] / 60));
-      min_next[dim_x] = next[dim_x] + 1;
-      min_next[dim_y] = next[dim_y] + 1;
-    }
-    if ((d->pc_tunnel[next[dim_y] - 1][next[dim_x] - 1] +
-         (d->hardness[next[dim_y] - 1][next[dim_x] - 1] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y] - 1][next[dim_x] - 1] +
-                  (d->hardness[next[dim_y] - 1][next[dim_x] - 1] / 60));
-      min_next[dim_x] = next[dim_x] - 1;
-      min_next[dim_y] = next[dim_y] - 1;
-    }
-    if ((d->pc_tunnel[next[dim_y] + 1][next[dim_x] - 1] +
-         (d->hardness[next[dim_y] + 1][next[dim_x] - 1] / 60)) < min_cost) {
-      min_cost = (d->pc_tunnel[next[dim_y] + 1][next[dim_x] - 1] +
-                  (d->hardness[next[dim_y] + 1][next[dim_x] - 1] / 60));
-      min_next[dim_x] = next[dim_x] - 1;
-      min_next[dim_y] = next[dim_y] + 1;
+    for (i = 0; i < 8; i++) {
+      y = next[dim_y] + gradient_neighbors[i].y;
+      x = next[dim_x] + gradient_neighbors[i].x;
+      cost = d->pc_tunnel[y][x] + gradient_dig_lut.cost[d->hardness[y][x]];
+      if (!i || cost < min_cost) {
+        min_cost = cost;
+        min_next[dim_x] = x;
+        min_next[dim_y] = y;
+      }
     }
     if (hardnesspair(min_next) <= 60) {
       if (hardnesspair(min_next)) {
@@ -279,60 +249,25 @@ void npc_next_pos_gradient(dungeon *d, npc *c, pair_t next)
         mappair(min_next) = ter_floor_hall;
 
         /* Update distance maps because map has changed. */
-        dijkstra(d);
-        dijkstra_tunnel(d);
+        path_cell_opened(d, min_next);
       }
 
       next[dim_x] = min_next[dim_x];
       next[dim_y] = min_next[dim_y];
     } else {
       hardnesspair(min_next) -= 60;
+      path_cell_softened(d, min_next);
     }
   } else {
     /* Make monsters prefer cardinal directions */
-    if (d->pc_distance[next[dim_y] - 1][next[dim_x]    ] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_y]--;
-      return;
-    }
-    if (d->pc_distance[next[dim_y] + 1][next[dim_x]    ] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_y]++;
-      return;
-    }
-    if (d->pc_distance[next[dim_y]    ][next[dim_x] + 1] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_x]++;
-      return;
-    }
-    if (d->pc_distance[next[dim_y]    ][next[dim_x] - 1] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_x]--;
-      return;
-    }
-    if (d->pc_distance[next[dim_y] - 1][next[dim_x] + 1] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_y]--;
-      next[dim_x]++;
-      return;
-    }
-    if (d->pc_distance[next[dim_y] + 1][next[dim_x] + 1] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_y]++;
-      next[dim_x]++;
-      return;
-    }
-    if (d->pc_distance[next[dim_y] - 1][next[dim_x] - 1] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_y]--;
-      next[dim_x]--;
-      return;
-    }
-    if (d->pc_distance[next[dim_y] + 1][next[dim_x] - 1] <
-        d->pc_distance[next[dim_y]][next[dim_x]]) {
-      next[dim_y]++;
-      next[dim_x]--;
-      return;
+    for (i = 0; i < 8; i++) {
+      y = next[dim_y] + gradient_neighbors[i].y;
+      x = next[dim_x] + gradient_neighbors[i].x;
+      if (d->pc_distance[y][x] < d->pc_distance[next[dim_y]][next[dim_x]]) {
+        next[dim_y] = y;
+        next[dim_x] = x;
+        return;
+      }
     }
   }
 }
@@ -340,7 +275,7 @@ void npc_next_pos_gradient(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_00(dungeon *d, npc *c, pair_t next)
 {
   /* not smart; not telepathic; not tunneling; not erratic */
-  if (can_see(d, character_get_pos(c), character_get_pos(d->PC), 0, 0)) {
+  if (can_see_pc(d, character_get_pos(c))) {
     c->pc_last_known_position[dim_y] = d->PC->position[dim_y];
     c->pc_last_known_position[dim_x] = d->PC->position[dim_x];
     npc_next_pos_line_of_sight(d, c, next);
@@ -352,7 +287,7 @@ static void npc_next_pos_00(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_01(dungeon *d, npc *c, pair_t next)
 {
   /*     smart; not telepathic; not tunneling; not erratic */
-  if (can_see(d, character_get_pos(c), character_get_pos(d->PC), 0, 0)) {
+  if (can_see_pc(d, character_get_pos(c))) {
     c->pc_last_known_position[dim_y] = d->PC->position[dim_y];
     c->pc_last_known_position[dim_x] = d->PC->position[dim_x];
     c->have_seen_pc = 1;
@@ -384,7 +319,7 @@ static void npc_next_pos_03(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_04(dungeon *d, npc *c, pair_t next)
 {
   /* not smart; not telepathic;     tunneling; not erratic */
-  if (can_see(d, character_get_pos(c), character_get_pos(d->PC), 0, 0)) {
+  if (can_see_pc(d, character_get_pos(c))) {
     c->pc_last_known_position[dim_y] = d->PC->position[dim_y];
     c->pc_last_known_position[dim_x] = d->PC->position[dim_x];
     npc_next_pos_line_of_sight(d, c, next);
@@ -396,7 +331,7 @@ static void npc_next_pos_04(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_05(dungeon *d, npc *c, pair_t next)
 {
   /*     smart; not telepathic;     tunneling; not erratic */
-  if (can_see(d, character_get_pos(c), character_get_pos(d->PC), 0, 0)) {
+  if (can_see_pc(d, character_get_pos(c))) {
     c->pc_last_known_position[dim_y] = d->PC->position[dim_y];
     c->pc_last_known_position[dim_x] = d->PC->position[dim_x];
     c->have_seen_pc = 1;
@@ -513,7 +448,7 @@ static void npc_next_pos_10(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_11(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart; not telepathic; not tunneling; not erratic */
-  if (can_see(d, character_get_pos(c), character_get_pos(d->PC), 0, 0)) {
+  if (can_see_pc(d, character_get_pos(c))) {
     c->pc_last_known_position[dim_y] = character_get_y(d->PC);
     c->pc_last_known_position[dim_x] = character_get_x(d->PC);
     c->have_seen_pc = 1;
@@ -547,7 +482,7 @@ static void npc_next_pos_13(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_14(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart; not telepathic;     tunneling; not erratic */
-  if (can_see(d, character_get_pos(c), character_get_pos(d->PC), 0, 0)) {
+  if (can_see_pc(d, character_get_pos(c))) {
     c->pc_last_known_position[dim_y] = character_get_y(d->PC);
     c->pc_last_known_position[dim_x] = character_get_x(d->PC);
     npc_next_pos_line_of_sight(d, c, next);
@@ -696,6 +631,61 @@ void (*npc_move_func[])(dungeon *d, npc *c, pair_t next) = {
   npc_next_pos_1f,
 };
 
+/* Monsters that pick up or destroy objects take whatever they're *
+ * standing on.                                                    */
+static void npc_take_objects(dungeon *d, npc *c)
+{
+  object *o, *tail;
+  uint32_t seen;
+
+  if (!(o = objpair(c->position))) {
+    return;
+  }
+  objpair(c->position) = NULL;
+  path_targets_changed(d, path_target_objects);
+
+  seen = can_see(d, character_get_pos(d->PC), character_get_pos(c), 1, 0);
+  if (seen) {
+    io_queue_message("%s%s %s %s%s.", is_unique(c) ? "" : "The ", c->name,
+                     (c->characteristics & NPC_PICKUP_OBJ) ?
+                     "picks up" : "destroys",
+                     o->get_name(), o->get_next() ? " and more" : "");
+  }
+
+  if (c->characteristics & NPC_PICKUP_OBJ) {
+    tail = o;
+    while (tail->get_next()) {
+      tail = tail->get_next();
+    }
+    tail->set_next(c->carried);
+    c->carried = o;
+  } else {
+    delete o;
+  }
+}
+
+/* ...and head for the nearest pile when it's closer than the PC and  *
+ * the PC is out of sight; a monster chasing the PC only stops for a   *
+ * pile right next to it.  Both distances are lookups, so this costs   *
+ * the same however many objects there are.                            */
+static uint32_t npc_next_pos_objects(dungeon *d, npc *c, pair_t next)
+{
+  uint8_t distance;
+
+  path_update(d);
+  path_target_update(d, path_target_objects);
+
+  distance = d->target_distance[path_target_objects]
+                               [c->position[dim_y]][c->position[dim_x]];
+  if (distance > 1 &&
+      (distance >= d->pc_distance[c->position[dim_y]][c->position[dim_x]] ||
+       can_see_pc(d, character_get_pos(c)))) {
+    return 1;
+  }
+
+  return path_target_next(d, path_target_objects, c->position, next);
+}
+
 void npc_next_pos(dungeon *d, npc *c, pair_t next)
 {
   int following = 1;
@@ -703,6 +693,12 @@ void npc_next_pos(dungeon *d, npc *c, pair_t next)
   next[dim_x] = c->position[dim_x];
 
   if(!c->bribed){
+    if (c->characteristics & (NPC_PICKUP_OBJ | NPC_DESTROY_OBJ)) {
+      npc_take_objects(d, c);
+      if (!npc_next_pos_objects(d, c, next)) {
+        return;
+      }
+    }
     npc_move_func[c->characteristics & 0x0000001f](d, c, next);
     return;
   } else {
@@ -765,6 +761,7 @@ npc::npc(dungeon *d, monster_description &m) : md(m)
   sequence_number = ++d->character_sequence_number;
   characteristics = m.abilities;
   have_seen_pc = 0;
+  carried = NULL;
   name = m.name.c_str();
   description = (const char *) m.description.c_str();
   for (i = 0; i < num_kill_types; i++) {
@@ -775,6 +772,9 @@ npc::npc(dungeon *d, monster_description &m) : md(m)
 
 npc::~npc()
 {
+  if (carried) {
+    delete carried;
+  }
   if (alive) {
     md.destroy();
   } else {
@@ -45,6 +45,7 @@
 
 typedef uint32_t npc_characteristics_t;
 class monster_description;
+class object;
 
 class npc : public character {
  public:
@@ -58,6 +59,9 @@ class npc : public character {
   pair_t pc_last_known_position;
   const char *description;
   monster_description &md;
+  /* What NPC_PICKUP_OBJ monsters have picked up, as a pile; dropped *
+   * where they die.                                                 */
+  object *carried;
 };
 
 void gen_monsters(dungeon *d);
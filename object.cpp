@@ -4,6 +4,7 @@
 #include "object.h"
 #include "dungeon.h"
 #include "utils.h"
+#include "path.h"
 
 object::object(const object_description &o, pair_t p, object *next) :
   name(o.get_name()),
@@ -74,6 +75,7 @@ void gen_object(dungeon_t *d)
   o = new object(od, p, d->objmap[p[dim_y]][p[dim_x]]);
 
   d->objmap[p[dim_y]][p[dim_x]] = o;  
+  path_targets_changed(d, path_target_objects);
 }
 
 void gen_objects(dungeon_t *d)
@@ -167,4 +169,5 @@ void object::to_pile(dungeon_t *d, pair_t location)
 {
   next = (object *) d->objmap[location[dim_y]][location[dim_x]];
   d->objmap[location[dim_y]][location[dim_x]] = this;
+  path_targets_changed(d, path_target_objects);
 }
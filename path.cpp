@@ -1,268 +1,869 @@
+#include <stdio.h>
+#include <stdlib.h>
+
 #include "path.h"
 #include "dungeon.h"
 #include "pc.h"
+#include "io.h"
+#include "relax.h"
+
+/* Set to 0 to build the sweep engine without SSE2 and AVX2. */
+#ifndef PATH_SWEEP_SIMD
+# define PATH_SWEEP_SIMD 1
+#endif
+
+#if PATH_SWEEP_SIMD && defined(__SSE2__)
+# define PATH_SWEEP_SSE2
+# include <immintrin.h>
+#endif
+
+/* Set to 1 to check every incremental repair against a full recompute. *
+ * Mismatches are reported on the message queue, and the full results   *
+ * are kept so that a bad repair can't propagate.                       */
+#ifndef VALIDATE_PATH_REPAIR
+# define VALIDATE_PATH_REPAIR 0
+#endif
 
-/* Ugly hack: There is no way to pass a pointer to the dungeon into the *
- * heap's comparitor funtion without modifying the heap.  Copying the   *
- * pc_distance array is a possible solution, but that doubles the       *
- * bandwidth requirements for dijkstra, which would also be bad.        *
- * Instead, make a global pointer to the dungeon in this file,          *
- * initialize it in dijkstra, and use it in the comparitor to get to    *
- * pc_distance.  Otherwise, pretend it doesn't exist, because it really *
- * is ugly.                                                             */
-static dungeon *the_dungeon;
+/* The engine is process-wide configuration, set once at startup.  All *
+ * mutable state lives in the path_context below.                       */
+static path_engine_t path_engine = PATH_ENGINE_DEFAULT;
 
 typedef struct path {
   heap_node_t *hn;
   uint8_t pos[2];
 } path_t;
 
-static int32_t dist_cmp(const void *key, const void *with) {
-  return ((int32_t) the_dungeon->pc_distance[((path_t *) key)->pos[dim_y]]
-                                            [((path_t *) key)->pos[dim_x]] -
-          (int32_t) the_dungeon->pc_distance[((path_t *) with)->pos[dim_y]]
-                                            [((path_t *) with)->pos[dim_x]]);
-}
+/* Dial's algorithm.  Edge weights are tiny integers (1 for walking, at *
+ * most 4 for tunneling) and both maps saturate at 255, so we keep one  *
+ * doubly-linked list of cells per distance value.  Cells only enter a  *
+ * bucket once they've been reached, and a decrease-key is an unlink    *
+ * followed by a push.  No allocation, no comparator calls.             */
+
+# define PATH_NUM_BUCKETS 256
+# define PATH_NOT_QUEUED  -2
+
+typedef struct bucket_queue {
+  int16_t head[PATH_NUM_BUCKETS];
+  int16_t next[DUNGEON_Y * DUNGEON_X];
+  int16_t prev[DUNGEON_Y * DUNGEON_X];
+} bucket_queue_t;
+
+/* The sweep engine works on rows padded on both sides, so that vector *
+ * loads one cell to either side of a row, and stores that run past its *
+ * end, stay inside the row.  Padding is closed and stays at 255.       */
+# define SWEEP_PAD    16
+# define SWEEP_STRIDE (SWEEP_PAD + DUNGEON_X + 32)
 
-static int32_t tunnel_cmp(const void *key, const void *with) {
-  return ((int32_t) the_dungeon->pc_tunnel[((path_t *) key)->pos[dim_y]]
-                                          [((path_t *) key)->pos[dim_x]] -
-          (int32_t) the_dungeon->pc_tunnel[((path_t *) with)->pos[dim_y]]
-                                          [((path_t *) with)->pos[dim_x]]);
+/* Both maps for one PC position on one version of the map.  An entry *
+ * with last_used == 0 is empty.                                       */
+typedef struct path_cache_entry {
+  uint32_t generation;
+  uint32_t tunnel_generation;
+  uint32_t last_used;
+  pair_t pos;
+  uint8_t distance[DUNGEON_Y][DUNGEON_X];
+  uint8_t tunnel[DUNGEON_Y][DUNGEON_X];
+} path_cache_entry_t;
+
+/* Everything a search writes besides the distance maps themselves.  One *
+ * of these per dungeon means searches on different dungeons never share *
+ * anything, so they can run concurrently.                               */
+struct path_context {
+  path_t node[DUNGEON_Y][DUNGEON_X];
+  /* The heap engine's heaps are built in one batch from heap_data, and *
+   * keep their node blocks from one search to the next.                */
+  heap_t walk_h;
+  heap_t tunnel_h;
+  void *heap_data[DUNGEON_Y * DUNGEON_X];
+  heap_node_t *heap_node[DUNGEON_Y * DUNGEON_X];
+  /* Every push goes to a bucket below 255 and we drain all of those, so *
+   * the queues are always empty between calls.                          */
+  bucket_queue_t walk_q;
+  bucket_queue_t tunnel_q;
+  uint8_t attr[DUNGEON_Y * DUNGEON_X];
+  /* The sweep engine's padded copies of the walk map; see below. */
+  uint8_t sweep_dist[DUNGEON_Y][SWEEP_STRIDE];
+  uint8_t sweep_closed[DUNGEON_Y][SWEEP_STRIDE];
+  /* The field cache; see path.h.  clock counts lookups and stores, *
+   * and stamps each entry's last_used.                             */
+  uint32_t clock;
+  path_cache_entry_t cache[PATH_CACHE_SIZE];
+};
+
+/* dist is the distance map being computed, passed through by the heap. */
+static int32_t path_cmp(const void *key, const void *with, void *dist) {
+  return ((int32_t) ((uint8_t *) dist)[((path_t *) key)->pos[dim_y] *
+                                       DUNGEON_X +
+                                       ((path_t *) key)->pos[dim_x]] -
+          (int32_t) ((uint8_t *) dist)[((path_t *) with)->pos[dim_y] *
+                                       DUNGEON_X +
+                                       ((path_t *) with)->pos[dim_x]]);
 }
 
-void dijkstra(dungeon_t *d)
+/* The heap engine.  Cells enter the heap all at once and stay there *
+ * until they're popped, so "still queued" is simply a non-NULL node. */
+struct path_heap_search {
+  path_t (*p)[DUNGEON_X];
+  uint8_t (*distance)[DUNGEON_X];
+  heap_t *h;
+  inline bool queued(uint32_t y, uint32_t x) const
+  {
+    return p[y][x].hn;
+  }
+  inline int32_t dist(uint32_t y, uint32_t x) const
+  {
+    return distance[y][x];
+  }
+  inline void improve(uint32_t y, uint32_t x, int32_t nd, uint32_t, uint32_t)
+  {
+    distance[y][x] = nd;
+    heap_decrease_key_no_replace(h, p[y][x].hn);
+  }
+};
+
+template <class Policy>
+static void dijkstra_heap(dungeon_t *d, heap_t *h,
+                          uint8_t distance[DUNGEON_Y][DUNGEON_X])
 {
-  heap_t h;
-  uint32_t x, y;
-  static path_t p[DUNGEON_Y][DUNGEON_X], *c;
-  static uint32_t initialized = 0;
-
-  if (!initialized) {
-    initialized = 1;
-    the_dungeon = d;
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
+  Policy policy = { d };
+  path_heap_search s = { d->path_ctx->node, distance, h };
+  uint32_t x, y, i, n;
+  path_t *c;
+
+  memset(distance, 255, DUNGEON_Y * DUNGEON_X);
+  distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+
+  for (n = 0, y = 0; y < DUNGEON_Y; y++) {
+    for (x = 0; x < DUNGEON_X; x++) {
+      if (policy.open(y, x)) {
+        d->path_ctx->heap_data[n++] = &s.p[y][x];
+      } else {
+        s.p[y][x].hn = NULL;
       }
     }
   }
+  if (heap_build(h, d->path_ctx->heap_data, n, d->path_ctx->heap_node)) {
+    perror("heap_build");
+    exit(1);
+  }
+  for (i = 0; i < n; i++) {
+    ((path_t *) d->path_ctx->heap_data[i])->hn = d->path_ctx->heap_node[i];
+  }
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      d->pc_distance[y][x] = 255;
-    }
+  while ((c = (path_t *) heap_remove_min(h))) {
+    c->hn = NULL;
+    relax(policy, s, c->pos[dim_y], c->pos[dim_x]);
   }
-  d->pc_distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+  heap_reset(h);
+}
 
-  heap_init(&h, dist_cmp, NULL);
+static void bucket_queue_init(bucket_queue_t *q)
+{
+  uint32_t i;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) >= ter_floor) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
+  for (i = 0; i < PATH_NUM_BUCKETS; i++) {
+    q->head[i] = -1;
+  }
+  for (i = 0; i < DUNGEON_Y * DUNGEON_X; i++) {
+    q->prev[i] = PATH_NOT_QUEUED;
+  }
+}
+
+static void bucket_queue_push(bucket_queue_t *q, int16_t i, uint8_t b)
+{
+  q->next[i] = q->head[b];
+  q->prev[i] = -1;
+  if (q->head[b] >= 0) {
+    q->prev[q->head[b]] = i;
+  }
+  q->head[b] = i;
+}
+
+static void bucket_queue_remove(bucket_queue_t *q, int16_t i, uint8_t b)
+{
+  if (q->prev[i] >= 0) {
+    q->next[q->prev[i]] = q->next[i];
+  } else {
+    q->head[b] = q->next[i];
+  }
+  if (q->next[i] >= 0) {
+    q->prev[q->next[i]] = q->prev[i];
+  }
+  q->prev[i] = PATH_NOT_QUEUED;
+}
+
+/* neighbors8, as offsets into the flattened maps. */
+# define bucket_offset(i) (neighbors8[i].y * DUNGEON_X + neighbors8[i].x)
+static constexpr int16_t bucket_neighbor[8] = {
+  bucket_offset(0), bucket_offset(1), bucket_offset(2), bucket_offset(3),
+  bucket_offset(4), bucket_offset(5), bucket_offset(6), bucket_offset(7)
+};
+
+# define bucket_cell_open(map, i, tunnel)             \
+  ((tunnel) ? ((map)[i] != ter_wall_immutable) :       \
+              ((map)[i] >= ter_floor))
+# define bucket_cell_cost(hardness, i, tunnel)        \
+  ((tunnel) ? tunnel_cost_lut.cost[(hardness)[i]] : 1)
+
+static void bucket_queue_drain(dungeon_t *d, bucket_queue_t *q,
+                               uint8_t *dist, uint32_t tunnel, uint32_t first)
+{
+  const terrain_type_t *map = &d->map[0][0];
+  const uint8_t *hardness = &d->hardness[0][0];
+  int16_t c, n;
+  uint32_t b, i, nd;
+
+  /* Nothing can be relaxed from bucket 255; distances there are "infinite." */
+  for (b = first; b < PATH_NUM_BUCKETS - 1; b++) {
+    while ((c = q->head[b]) >= 0) {
+      bucket_queue_remove(q, c, b);
+      nd = b + bucket_cell_cost(hardness, c, tunnel);
+      for (i = 0; i < 8; i++) {
+        n = c + bucket_neighbor[i];
+        if (!bucket_cell_open(map, n, tunnel) || nd >= dist[n]) {
+          continue;
+        }
+        if (q->prev[n] != PATH_NOT_QUEUED) {
+          bucket_queue_remove(q, n, dist[n]);
+        }
+        dist[n] = nd;
+        bucket_queue_push(q, n, nd);
       }
     }
   }
+}
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
+static void dijkstra_bucket(dungeon_t *d, uint8_t *dist, uint32_t tunnel)
+{
+  bucket_queue_t *q = tunnel ? &d->path_ctx->tunnel_q : &d->path_ctx->walk_q;
+  int16_t source;
+
+  memset(dist, 255, DUNGEON_Y * DUNGEON_X);
+
+  /* The heap versions never pop the PC's cell if it isn't open, *
+   * so we don't seed from it, either.                           */
+  source = d->PC->position[dim_y] * DUNGEON_X + d->PC->position[dim_x];
+  dist[source] = 0;
+  if (!bucket_cell_open(&d->map[0][0], source, tunnel)) {
+    return;
+  }
+  bucket_queue_push(q, source, 0);
+  bucket_queue_drain(d, q, dist, tunnel, 0);
+}
+
+/* Both maps at once.  One pass over map and hardness packs everything  *
+ * the searches need into a byte per cell and initializes both distance *
+ * arrays; from then on the two bucket queues are drained in lockstep,  *
+ * reading only the packed attributes.                                  */
+# define PATH_ATTR_WALK   0x80
+# define PATH_ATTR_TUNNEL 0x40
+# define PATH_ATTR_COST   0x07
+
+static void dijkstra_bucket_fields(dungeon_t *d)
+{
+  uint8_t *attr = d->path_ctx->attr;
+  bucket_queue_t *walk_q = &d->path_ctx->walk_q;
+  bucket_queue_t *tunnel_q = &d->path_ctx->tunnel_q;
+  const terrain_type_t *map = &d->map[0][0];
+  const uint8_t *hardness = &d->hardness[0][0];
+  uint8_t *walk = &d->pc_distance[0][0];
+  uint8_t *tunnel = &d->pc_tunnel[0][0];
+  int16_t c, n, source;
+  uint32_t b, i, nd;
+
+  for (i = 0; i < DUNGEON_Y * DUNGEON_X; i++) {
+    attr[i] = (((map[i] >= ter_floor) ? PATH_ATTR_WALK : 0)             |
+               ((map[i] != ter_wall_immutable) ? PATH_ATTR_TUNNEL : 0)  |
+               tunnel_cost_lut.cost[hardness[i]]);
+    walk[i] = tunnel[i] = 255;
+  }
+
+  source = d->PC->position[dim_y] * DUNGEON_X + d->PC->position[dim_x];
+  walk[source] = tunnel[source] = 0;
+  if (attr[source] & PATH_ATTR_WALK) {
+    bucket_queue_push(walk_q, source, 0);
+  }
+  if (attr[source] & PATH_ATTR_TUNNEL) {
+    bucket_queue_push(tunnel_q, source, 0);
+  }
+
+  for (b = 0; b < PATH_NUM_BUCKETS - 1; b++) {
+    while ((c = walk_q->head[b]) >= 0) {
+      bucket_queue_remove(walk_q, c, b);
+      nd = b + 1;
+      for (i = 0; i < 8; i++) {
+        n = c + bucket_neighbor[i];
+        if (!(attr[n] & PATH_ATTR_WALK) || nd >= walk[n]) {
+          continue;
+        }
+        if (walk_q->prev[n] != PATH_NOT_QUEUED) {
+          bucket_queue_remove(walk_q, n, walk[n]);
+        }
+        walk[n] = nd;
+        bucket_queue_push(walk_q, n, nd);
+      }
     }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
+    while ((c = tunnel_q->head[b]) >= 0) {
+      bucket_queue_remove(tunnel_q, c, b);
+      nd = b + (attr[c] & PATH_ATTR_COST);
+      for (i = 0; i < 8; i++) {
+        n = c + bucket_neighbor[i];
+        if (!(attr[n] & PATH_ATTR_TUNNEL) || nd >= tunnel[n]) {
+          continue;
+        }
+        if (tunnel_q->prev[n] != PATH_NOT_QUEUED) {
+          bucket_queue_remove(tunnel_q, n, tunnel[n]);
+        }
+        tunnel[n] = nd;
+        bucket_queue_push(tunnel_q, n, nd);
+      }
     }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
+  }
+}
+
+/* Raster sweeps for the walk map.  Walking costs 1 in all 8 directions, *
+ * so a cell's distance is one more than the smallest of its neighbors'.  *
+ * A top-to-bottom pass takes each row's three upper neighbors from the  *
+ * row above, all 80 cells at once with saturating byte minimums, then   *
+ * runs along the row in both directions to pick up its own neighbors.   *
+ * A bottom-to-top pass does the same from below.  Each pair of passes   *
+ * follows every path that changes vertical direction at most once more, *
+ * so we repeat them until a pair changes nothing.  Closed cells are     *
+ * forced back to 255 on every row, so nothing ever passes through one.  *
+ *                                                                       *
+ * The vertical step is vectorized with AVX2 when the CPU has it, SSE2   *
+ * otherwise, and falls back to plain C elsewhere.  All three produce    *
+ * exactly the heap engine's map.                                        */
+
+typedef uint32_t (*sweep_row_func_t)(uint8_t *row, const uint8_t *from,
+                                     const uint8_t *closed);
+
+/* row = min(row, min(from[x - 1], from[x], from[x + 1]) + 1) | closed; *
+ * returns non-zero if row changed.                                     */
+#if !defined(PATH_SWEEP_SSE2)
+static uint32_t sweep_row_scalar(uint8_t *row, const uint8_t *from,
+                                 const uint8_t *closed)
+{
+  uint32_t x, m, changed;
+
+  for (changed = 0, x = SWEEP_PAD; x < SWEEP_PAD + DUNGEON_X; x++) {
+    m = from[x - 1] < from[x] ? from[x - 1] : from[x];
+    m = from[x + 1] < m ? from[x + 1] : m;
+    m = m < 255 ? m + 1 : 255;
+    m = (m < row[x] ? m : row[x]) | closed[x];
+    changed |= m ^ row[x];
+    row[x] = m;
+  }
+
+  return changed;
+}
+#else
+static uint32_t sweep_row_sse2(uint8_t *row, const uint8_t *from,
+                               const uint8_t *closed)
+{
+  __m128i m, old, one, changed;
+  uint32_t x;
+
+  one = _mm_set1_epi8(1);
+  changed = _mm_setzero_si128();
+  for (x = SWEEP_PAD; x < SWEEP_PAD + DUNGEON_X; x += 16) {
+    m = _mm_min_epu8(_mm_loadu_si128((const __m128i *) (from + x - 1)),
+                     _mm_loadu_si128((const __m128i *) (from + x)));
+    m = _mm_min_epu8(m, _mm_loadu_si128((const __m128i *) (from + x + 1)));
+    m = _mm_adds_epu8(m, one);
+    old = _mm_loadu_si128((const __m128i *) (row + x));
+    m = _mm_or_si128(_mm_min_epu8(m, old),
+                     _mm_loadu_si128((const __m128i *) (closed + x)));
+    changed = _mm_or_si128(changed, _mm_xor_si128(m, old));
+    _mm_storeu_si128((__m128i *) (row + x), m);
+  }
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(changed,
+                                          _mm_setzero_si128())) != 0xffff;
+}
+
+/* Three 32-byte vectors cover the row and 16 cells of right padding. */
+__attribute__((target("avx2")))
+static uint32_t sweep_row_avx2(uint8_t *row, const uint8_t *from,
+                               const uint8_t *closed)
+{
+  __m256i m, old, one, changed;
+  uint32_t x;
+
+  one = _mm256_set1_epi8(1);
+  changed = _mm256_setzero_si256();
+  for (x = SWEEP_PAD; x < SWEEP_PAD + DUNGEON_X; x += 32) {
+    m = _mm256_min_epu8(_mm256_loadu_si256((const __m256i *) (from + x - 1)),
+                        _mm256_loadu_si256((const __m256i *) (from + x)));
+    m = _mm256_min_epu8(m, _mm256_loadu_si256((const __m256i *)
+                                              (from + x + 1)));
+    m = _mm256_adds_epu8(m, one);
+    old = _mm256_loadu_si256((const __m256i *) (row + x));
+    m = _mm256_or_si256(_mm256_min_epu8(m, old),
+                        _mm256_loadu_si256((const __m256i *) (closed + x)));
+    changed = _mm256_or_si256(changed, _mm256_xor_si256(m, old));
+    _mm256_storeu_si256((__m256i *) (row + x), m);
+  }
+
+  return !_mm256_testz_si256(changed, changed);
+}
+#endif
+
+static sweep_row_func_t sweep_row_select(void)
+{
+#if defined(PATH_SWEEP_SSE2)
+  if (__builtin_cpu_supports("avx2")) {
+    return sweep_row_avx2;
+  }
+  return sweep_row_sse2;
+#else
+  return sweep_row_scalar;
+#endif
+}
+
+/* Within a row, each cell's left and right neighbors.  A serial chain, *
+ * so there's nothing to vectorize, but it's only 80 cells.             */
+static uint32_t sweep_row_across(uint8_t *row, const uint8_t *closed)
+{
+  uint32_t x, changed;
+
+  changed = 0;
+  for (x = SWEEP_PAD + 1; x < SWEEP_PAD + DUNGEON_X - 1; x++) {
+    if (!closed[x] && row[x - 1] + 1 < row[x]) {
+      row[x] = row[x - 1] + 1;
+      changed = 1;
     }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
+  }
+  for (x = SWEEP_PAD + DUNGEON_X - 2; x > SWEEP_PAD; x--) {
+    if (!closed[x] && row[x + 1] + 1 < row[x]) {
+      row[x] = row[x + 1] + 1;
+      changed = 1;
     }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
+  }
+
+  return changed;
+}
+
+static void dijkstra_sweep(dungeon_t *d)
+{
+  static sweep_row_func_t sweep_row = sweep_row_select();
+  uint8_t (*dist)[SWEEP_STRIDE] = d->path_ctx->sweep_dist;
+  uint8_t (*closed)[SWEEP_STRIDE] = d->path_ctx->sweep_closed;
+  uint32_t x, y, changed;
+
+  memset(dist, 255, sizeof (d->path_ctx->sweep_dist));
+  memset(closed, 255, sizeof (d->path_ctx->sweep_closed));
+  for (y = 0; y < DUNGEON_Y; y++) {
+    for (x = 0; x < DUNGEON_X; x++) {
+      if (d->map[y][x] >= ter_floor) {
+        closed[y][SWEEP_PAD + x] = 0;
+      }
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
+  }
+
+  /* As with the bucket engine, a closed PC cell seeds nothing. */
+  y = d->PC->position[dim_y];
+  x = d->PC->position[dim_x];
+  if (!closed[y][SWEEP_PAD + x]) {
+    dist[y][SWEEP_PAD + x] = 0;
+  }
+
+  /* The border is always immutable rock, so only interior rows change. */
+  do {
+    changed = 0;
+    for (y = 1; y < DUNGEON_Y - 1; y++) {
+      changed |= sweep_row(dist[y], dist[y - 1], closed[y]);
+      changed |= sweep_row_across(dist[y], closed[y]);
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
+    for (y = DUNGEON_Y - 2; y > 0; y--) {
+      changed |= sweep_row(dist[y], dist[y + 1], closed[y]);
+      changed |= sweep_row_across(dist[y], closed[y]);
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
+  } while (changed);
+
+  for (y = 0; y < DUNGEON_Y; y++) {
+    memcpy(d->pc_distance[y], dist[y] + SWEEP_PAD, DUNGEON_X);
+  }
+  d->pc_distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+}
+
+/* Decrease-only repair.  Opening a cell or softening it can only shorten *
+ * paths, and every path that got shorter runs through the changed cell, *
+ * so it's enough to recompute that cell from its neighbors and then run  *
+ * Dijkstra outward from it.  Only cells that actually improve get        *
+ * queued, so the work is proportional to the affected region.           */
+static void dijkstra_bucket_repair(dungeon_t *d, uint8_t *dist,
+                                   uint32_t tunnel, int16_t u)
+{
+  const terrain_type_t *map = &d->map[0][0];
+  const uint8_t *hardness = &d->hardness[0][0];
+  bucket_queue_t *q = tunnel ? &d->path_ctx->tunnel_q : &d->path_ctx->walk_q;
+  uint32_t i, best, cand;
+  int16_t v;
+
+  if (!bucket_cell_open(map, u, tunnel)) {
+    return;
+  }
+
+  best = dist[u];
+  for (i = 0; i < 8; i++) {
+    v = u + bucket_neighbor[i];
+    if (bucket_cell_open(map, v, tunnel) &&
+        (cand = dist[v] + bucket_cell_cost(hardness, v, tunnel)) < best) {
+      best = cand;
     }
   }
-  heap_delete(&h);
+  dist[u] = best;
+
+  if (best < PATH_NUM_BUCKETS - 1) {
+    bucket_queue_push(q, u, best);
+    bucket_queue_drain(d, q, dist, tunnel, best);
+  }
 }
 
-/* Ignores the case of hardness == 255, because if *
- * that gets here, there's already been an error.  */
-#define tunnel_movement_cost(x, y)                      \
-  ((d->hardness[y][x] / 85) + 1)
+void dijkstra_repair(dungeon_t *d, pair_t pos)
+{
+  int16_t u;
 
-void dijkstra_tunnel(dungeon_t *d)
+  u = pos[dim_y] * DUNGEON_X + pos[dim_x];
+  dijkstra_bucket_repair(d, &d->pc_distance[0][0], 0, u);
+  dijkstra_bucket_repair(d, &d->pc_tunnel[0][0], 1, u);
+}
+
+path_context_t *path_context_new(dungeon_t *d)
 {
-  heap_t h;
+  path_context_t *ctx;
   uint32_t x, y;
-  uint32_t size;
-  static path_t p[DUNGEON_Y][DUNGEON_X], *c;
-  static uint32_t initialized = 0;
-
-  if (!initialized) {
-    initialized = 1;
-    the_dungeon = d;
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
-      }
-    }
+
+  if (!(ctx = (path_context_t *) malloc(sizeof (*ctx)))) {
+    perror("malloc");
+    exit(1);
   }
 
   for (y = 0; y < DUNGEON_Y; y++) {
     for (x = 0; x < DUNGEON_X; x++) {
-      d->pc_tunnel[y][x] = 255;
+      ctx->node[y][x].pos[dim_y] = y;
+      ctx->node[y][x].pos[dim_x] = x;
     }
   }
-  d->pc_tunnel[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+  heap_init_r(&ctx->walk_h, path_cmp, d->pc_distance, NULL);
+  heap_init_r(&ctx->tunnel_h, path_cmp, d->pc_tunnel, NULL);
+  bucket_queue_init(&ctx->walk_q);
+  bucket_queue_init(&ctx->tunnel_q);
+  ctx->clock = 0;
+  memset(ctx->cache, 0, sizeof (ctx->cache));
 
-  heap_init(&h, tunnel_cmp, NULL);
+  return ctx;
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) != ter_wall_immutable) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
+void path_context_delete(path_context_t *ctx)
+{
+  heap_delete(&ctx->walk_h);
+  heap_delete(&ctx->tunnel_h);
+  free(ctx);
+}
+
+/* Copies the cached maps for the PC's current position and map into *
+ * place, if there are any, recomputing only the tunneling map if     *
+ * rock has been softened since.  Returns non-zero on a miss.         */
+static uint32_t path_cache_lookup(dungeon_t *d)
+{
+  path_cache_entry_t *e;
+  uint32_t i;
+
+  for (i = 0; i < PATH_CACHE_SIZE; i++) {
+    e = &d->path_ctx->cache[i];
+    if (e->last_used                               &&
+        e->generation == d->map_generation         &&
+        e->pos[dim_y] == d->PC->position[dim_y]    &&
+        e->pos[dim_x] == d->PC->position[dim_x]) {
+      e->last_used = ++d->path_ctx->clock;
+      memcpy(d->pc_distance, e->distance, sizeof (d->pc_distance));
+      if (e->tunnel_generation == d->tunnel_generation) {
+        memcpy(d->pc_tunnel, e->tunnel, sizeof (d->pc_tunnel));
+      } else {
+        dijkstra_tunnel(d);
+        e->tunnel_generation = d->tunnel_generation;
+        memcpy(e->tunnel, d->pc_tunnel, sizeof (d->pc_tunnel));
       }
+
+      return 0;
     }
   }
 
-  size = h.size;
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    if (--size != h.size) {
-      exit(1);
-    }
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
+  return 1;
+}
+
+/* Saves the current maps, replacing any entry for the same position, *
+ * else an entry for an old map (which can never hit again), else the *
+ * least recently used.                                               */
+static void path_cache_store(dungeon_t *d)
+{
+  path_cache_entry_t *e, *victim;
+  uint32_t i;
+
+  for (victim = NULL, i = 0; i < PATH_CACHE_SIZE; i++) {
+    e = &d->path_ctx->cache[i];
+    if (e->pos[dim_y] == d->PC->position[dim_y] &&
+        e->pos[dim_x] == d->PC->position[dim_x]) {
+      victim = e;
+      break;
     }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
+    if (!victim                                                       ||
+        (e->generation != d->map_generation &&
+         victim->generation == d->map_generation)                     ||
+        ((e->generation != d->map_generation) ==
+         (victim->generation != d->map_generation) &&
+         e->last_used < victim->last_used)) {
+      victim = e;
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
+  }
+
+  victim->generation = d->map_generation;
+  victim->tunnel_generation = d->tunnel_generation;
+  victim->last_used = ++d->path_ctx->clock;
+  victim->pos[dim_y] = d->PC->position[dim_y];
+  victim->pos[dim_x] = d->PC->position[dim_x];
+  memcpy(victim->distance, d->pc_distance, sizeof (d->pc_distance));
+  memcpy(victim->tunnel, d->pc_tunnel, sizeof (d->pc_tunnel));
+}
+
+void path_invalidate(dungeon_t *d)
+{
+  d->path_stats.invalidations++;
+  d->path_dirty = 1;
+  d->path_num_pending = 0;
+}
+
+static void path_cell_repair(dungeon_t *d, pair_t pos)
+{
+  d->path_stats.invalidations++;
+  if (d->path_dirty) {
+    /* Already paying for a full recompute, which will include this. */
+    return;
+  }
+  if (d->path_num_pending == PATH_MAX_PENDING_REPAIRS) {
+    d->path_dirty = 1;
+    d->path_num_pending = 0;
+    return;
+  }
+  d->path_pending[d->path_num_pending][dim_y] = pos[dim_y];
+  d->path_pending[d->path_num_pending][dim_x] = pos[dim_x];
+  d->path_num_pending++;
+}
+
+void path_cell_opened(dungeon_t *d, pair_t pos)
+{
+  d->map_generation++;
+  d->tunnel_generation++;
+  bitboard_update(d, pos);
+  path_cell_repair(d, pos);
+}
+
+/* Rock that's still rock: the walking map, the target maps and the *
+ * bitboards are all unaffected.                                    */
+void path_cell_softened(dungeon_t *d, pair_t pos)
+{
+  d->tunnel_generation++;
+  path_cell_repair(d, pos);
+}
+
+void path_cell_closed(dungeon_t *d, pair_t pos)
+{
+  d->map_generation++;
+  d->tunnel_generation++;
+  bitboard_update(d, pos);
+  path_invalidate(d);
+}
+
+void path_update(dungeon_t *d)
+{
+  uint32_t i;
+#if VALIDATE_PATH_REPAIR
+  uint8_t distance[DUNGEON_Y][DUNGEON_X];
+  uint8_t tunnel[DUNGEON_Y][DUNGEON_X];
+#endif
+
+  if (d->path_dirty) {
+    d->path_dirty = 0;
+    d->path_num_pending = 0;
+    if (!path_cache_lookup(d)) {
+      d->path_stats.cache_hits++;
+#if VALIDATE_PATH_REPAIR
+      memcpy(distance, d->pc_distance, sizeof (distance));
+      memcpy(tunnel, d->pc_tunnel, sizeof (tunnel));
+      dijkstra_fields(d);
+      if (memcmp(distance, d->pc_distance, sizeof (distance)) ||
+          memcmp(tunnel, d->pc_tunnel, sizeof (tunnel))) {
+        io_queue_message("Distance map cache mismatch.");
+      }
+#endif
+      return;
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
+    dijkstra_fields(d);
+    d->path_stats.recomputes++;
+    path_cache_store(d);
+    return;
+  }
+
+  if (!d->path_num_pending) {
+    return;
+  }
+
+  /* Each repair propagates through the current map, which already has *
+   * every pending change applied, so the order doesn't matter.         */
+  for (i = 0; i < d->path_num_pending; i++) {
+    dijkstra_repair(d, d->path_pending[i]);
+    d->path_stats.repairs++;
+  }
+  d->path_num_pending = 0;
+  path_cache_store(d);
+
+#if VALIDATE_PATH_REPAIR
+  memcpy(distance, d->pc_distance, sizeof (distance));
+  memcpy(tunnel, d->pc_tunnel, sizeof (tunnel));
+  dijkstra(d);
+  dijkstra_tunnel(d);
+  if (memcmp(distance, d->pc_distance, sizeof (distance))) {
+    io_queue_message("Distance map repair mismatch.");
+  }
+  if (memcmp(tunnel, d->pc_tunnel, sizeof (tunnel))) {
+    io_queue_message("Tunnel map repair mismatch.");
+  }
+#endif
+}
+
+uint32_t path_recomputes_avoided(const path_stats_t *s)
+{
+  return s->invalidations - s->recomputes - s->repairs;
+}
+
+void path_targets_changed(dungeon_t *d, path_target_t t)
+{
+  d->target_dirty |= 1 << t;
+}
+
+static uint32_t path_is_target(dungeon_t *d, path_target_t t,
+                               uint32_t y, uint32_t x)
+{
+  switch (t) {
+  case path_target_objects:
+    return d->objmap[y][x] != NULL;
+  case num_path_targets:
+    break;
+  }
+
+  return 0;
+}
+
+/* The same drain as the PC's walk map, seeded with every target at *
+ * once.  The walk queue is always empty between searches.          */
+void path_target_update(dungeon_t *d, path_target_t t)
+{
+  bucket_queue_t *q = &d->path_ctx->walk_q;
+  uint8_t *dist = &d->target_distance[t][0][0];
+  uint32_t x, y;
+
+  if (!(d->target_dirty & (1 << t)) &&
+      d->target_generation[t] == d->map_generation) {
+    return;
+  }
+
+  memset(dist, 255, DUNGEON_Y * DUNGEON_X);
+  for (y = 1; y < DUNGEON_Y - 1; y++) {
+    for (x = 1; x < DUNGEON_X - 1; x++) {
+      if (path_is_target(d, t, y, x)) {
+        dist[y * DUNGEON_X + x] = 0;
+        bucket_queue_push(q, y * DUNGEON_X + x, 0);
+      }
     }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
+  }
+  bucket_queue_drain(d, q, dist, 0, 0);
+
+  d->target_dirty &= ~(1 << t);
+  d->target_generation[t] = d->map_generation;
+  d->path_stats.target_builds++;
+}
+
+uint32_t path_target_next(dungeon_t *d, path_target_t t,
+                          pair_t pos, pair_t next)
+{
+  uint32_t i, x, y;
+
+  path_target_update(d, t);
+
+  for (i = 0; i < 8; i++) {
+    y = pos[dim_y] + gradient_neighbors[i].y;
+    x = pos[dim_x] + gradient_neighbors[i].x;
+    if (d->target_distance[t][y][x] <
+        d->target_distance[t][pos[dim_y]][pos[dim_x]]) {
+      next[dim_y] = y;
+      next[dim_x] = x;
+      return 0;
     }
   }
-  heap_delete(&h);
+
+  return 1;
+}
+
+uint32_t path_cache_hit_rate(const path_stats_t *s)
+{
+  return (s->cache_hits ?
+          (uint64_t) s->cache_hits * 100 / (s->cache_hits + s->recomputes) :
+          0);
+}
+
+void path_set_engine(path_engine_t engine)
+{
+  path_engine = engine;
+}
+
+path_engine_t path_get_engine(void)
+{
+  return path_engine;
+}
+
+void dijkstra(dungeon_t *d)
+{
+  switch (path_engine) {
+  case path_engine_heap:
+    dijkstra_heap<walk_policy>(d, &d->path_ctx->walk_h, d->pc_distance);
+    break;
+  case path_engine_bucket:
+    dijkstra_bucket(d, &d->pc_distance[0][0], 0);
+    break;
+  case path_engine_sweep:
+    dijkstra_sweep(d);
+    break;
+  }
+}
+
+void dijkstra_tunnel(dungeon_t *d)
+{
+  switch (path_engine) {
+  case path_engine_heap:
+    dijkstra_heap<tunnel_policy>(d, &d->path_ctx->tunnel_h, d->pc_tunnel);
+    break;
+  case path_engine_bucket:
+  case path_engine_sweep:
+    dijkstra_bucket(d, &d->pc_tunnel[0][0], 1);
+    break;
+  }
+}
+
+void dijkstra_fields(dungeon_t *d)
+{
+  switch (path_engine) {
+  case path_engine_heap:
+    dijkstra_heap<walk_policy>(d, &d->path_ctx->walk_h, d->pc_distance);
+    dijkstra_heap<tunnel_policy>(d, &d->path_ctx->tunnel_h, d->pc_tunnel);
+    break;
+  case path_engine_bucket:
+    dijkstra_bucket_fields(d);
+    break;
+  case path_engine_sweep:
+    dijkstra_sweep(d);
+    dijkstra_bucket(d, &d->pc_tunnel[0][0], 1);
+    break;
+  }
 }
@@ -1,11 +1,99 @@
 #ifndef PATH_H
 # define PATH_H
 
+# include <stdint.h>
+
 # define HARDNESS_PER_TURN 85
 
+/* All engines produce identical maps.  The heap engine is the original  *
+ * Fibonacci heap implementation; the bucket engine is Dial's algorithm. *
+ * The sweep engine builds the walk map with vectorized raster sweeps,   *
+ * and the tunnel map (which has weighted edges) with Dial's algorithm.  */
+typedef enum path_engine {
+  path_engine_heap,
+  path_engine_bucket,
+  path_engine_sweep
+} path_engine_t;
+
+# define PATH_ENGINE_DEFAULT path_engine_bucket
+
+# include "dims.h"
+
 typedef struct dungeon dungeon_t;
 
+/* Scratch space for the searches: heap nodes, bucket queues, and so on. *
+ * Each dungeon owns one (see init_dungeon()), so nothing in path.cpp is *
+ * shared between dungeons.                                              */
+typedef struct path_context path_context_t;
+
+path_context_t *path_context_new(dungeon_t *d);
+void path_context_delete(path_context_t *ctx);
+void path_set_engine(path_engine_t engine);
+path_engine_t path_get_engine(void);
 void dijkstra(dungeon_t *d);
 void dijkstra_tunnel(dungeon_t *d);
+/* Equivalent to dijkstra() followed by dijkstra_tunnel(), but the bucket *
+ * engine builds both maps in a single traversal.                         */
+void dijkstra_fields(dungeon_t *d);
+/* Call after opening or softening the cell at pos.  Never call it after *
+ * closing or hardening a cell; that requires a full recompute.          */
+void dijkstra_repair(dungeon_t *d, pair_t pos);
+
+/* The distance maps are maintained lazily.  Anything that changes them *
+ * reports it with path_invalidate() (the PC moved), path_cell_opened() *
+ * (a cell was dug out), path_cell_softened() (rock was dug at but is   *
+ * still rock), or path_cell_closed() (a cell was filled or hardened),  *
+ * and anything that reads pc_distance or pc_tunnel must call           *
+ * path_update() first.  A batch of digs with no PC movement in between *
+ * is applied with incremental repairs; anything else collapses into    *
+ * one recompute.                                                       *
+ *                                                                      *
+ * Full recomputes go through a small LRU cache of map pairs, keyed by  *
+ * the PC's position and the dungeon's map_generation, which changes    *
+ * only with the terrain.  A PC pacing back and forth over an unchanged *
+ * map gets its maps back with a copy.  Softening only bumps            *
+ * tunnel_generation, so a cached walking map stays good and only the   *
+ * tunneling map is recomputed.  The cell functions also keep the       *
+ * bitboards (see bitboard.h) up to date, except path_cell_softened(),  *
+ * since they don't depend on hardness.                                 */
+# define PATH_MAX_PENDING_REPAIRS 16
+# define PATH_CACHE_SIZE          8
+
+typedef struct path_stats {
+  uint32_t invalidations; /* Changes reported; each used to be a recompute */
+  uint32_t recomputes;    /* Full recomputes actually performed            */
+  uint32_t repairs;       /* Incremental repairs actually performed        */
+  uint32_t cache_hits;    /* Recomputes answered from the cache            */
+  uint32_t target_builds; /* Target maps built; see path_target_update()   */
+} path_stats_t;
+
+void path_invalidate(dungeon_t *d);
+void path_cell_opened(dungeon_t *d, pair_t pos);
+void path_cell_softened(dungeon_t *d, pair_t pos);
+void path_cell_closed(dungeon_t *d, pair_t pos);
+void path_update(dungeon_t *d);
+uint32_t path_recomputes_avoided(const path_stats_t *s);
+
+/* Walking distance to the nearest of a set of targets, for everything *
+ * that wants to go somewhere other than the PC.  Each map is built     *
+ * with a single multi-source search, only when asked for, and only     *
+ * again after the map or the target set changes.                       */
+typedef enum path_target {
+  path_target_objects,  /* Any non-empty objmap cell */
+  num_path_targets
+} path_target_t;
+
+/* Call after adding or removing a target; map changes are tracked *
+ * through map_generation already.                                 */
+void path_targets_changed(dungeon_t *d, path_target_t t);
+/* Rebuilds d->target_distance[t] if it's stale. */
+void path_target_update(dungeon_t *d, path_target_t t);
+/* One step down target t's gradient from pos, preferring cardinal *
+ * directions as monsters do.  Returns non-zero, leaving next      *
+ * alone, if pos is on a target or can't reach one.                */
+uint32_t path_target_next(dungeon_t *d, path_target_t t,
+                          pair_t pos, pair_t next);
+/* Percentage of would-be recomputes that hit the cache. */
+uint32_t path_cache_hit_rate(const path_stats_t *s);
 
 #endif
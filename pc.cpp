@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include <ncurses.h>
 #include <string>
 
@@ -10,6 +11,7 @@
 #include "io.h"
 #include "object.h"
 #include "descriptions.h"
+#include "fov.h"
 
 const char *eq_slot_name[num_eq_slots] = {
   "weapon",
@@ -102,8 +104,7 @@ void config_pc(dungeon_t *d)
 
   d->character_map[character_get_y(d->PC)][character_get_x(d->PC)] = d->PC;
 
-  dijkstra(d);
-  dijkstra_tunnel(d);
+  path_invalidate(d);
 }
 
 uint32_t pc_next_pos(dungeon_t *d, pair_t dir)
@@ -206,34 +207,62 @@ uint32_t pc_next_pos(dungeon_t *d, pair_t dir)
 
 uint32_t pc_in_room(dungeon_t *d, uint32_t room)
 {
-  if ((room < d->num_rooms)                                     &&
-      (d->PC->position[dim_x] >= d->rooms[room].position[dim_x]) &&
-      (d->PC->position[dim_x] < (d->rooms[room].position[dim_x] +
-                                d->rooms[room].size[dim_x]))    &&
-      (d->PC->position[dim_y] >= d->rooms[room].position[dim_y]) &&
-      (d->PC->position[dim_y] < (d->rooms[room].position[dim_y] +
-                                d->rooms[room].size[dim_y]))) {
-    return 1;
-  }
-
-  return 0;
+  return (room < d->num_rooms &&
+          (d->room_id[d->PC->position[dim_y]][d->PC->position[dim_x]] ==
+           room + 1));
 }
 
+static_assert(ter_stairs_down < 16, "terrain must fit in a nibble");
+
 void pc_learn_terrain(pc *p, pair_t pos, terrain_type_t ter)
 {
-  p->known_terrain[pos[dim_y]][pos[dim_x]] = ter;
-  p->visible[pos[dim_y]][pos[dim_x]] = 1;
+  uint8_t *cell = &p->known_terrain[pos[dim_y]][pos[dim_x] >> 1];
+  uint32_t shift = (pos[dim_x] & 1) << 2;
+
+  *cell = (*cell & ~(0xf << shift)) | (ter << shift);
+  p->visible[pos[dim_y]] |= BITROW_ONE << pos[dim_x];
+
+  if (pos[dim_y] < p->lit_min[dim_y]) {
+    p->lit_min[dim_y] = pos[dim_y];
+  }
+  if (pos[dim_y] > p->lit_max[dim_y]) {
+    p->lit_max[dim_y] = pos[dim_y];
+  }
+  if (pos[dim_x] < p->lit_min[dim_x]) {
+    p->lit_min[dim_x] = pos[dim_x];
+  }
+  if (pos[dim_x] > p->lit_max[dim_x]) {
+    p->lit_max[dim_x] = pos[dim_x];
+  }
 }
 
+static void pc_empty_lit_box(pc *p)
+{
+  p->lit_min[dim_y] = DUNGEON_Y;
+  p->lit_min[dim_x] = DUNGEON_X;
+  p->lit_max[dim_y] = -1;
+  p->lit_max[dim_x] = -1;
+}
+
+/* Only the box lit since the last reset can hold visible cells, so that *
+ * is all that needs clearing; a move touches the light radius squared, *
+ * not the whole map.                                                   */
 void pc_reset_visibility(pc *p)
 {
-  uint32_t y, x;
+  int32_t y;
+  bitrow_t lit;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      p->visible[y][x] = 0;
-    }
+  if (p->lit_min[dim_y] > p->lit_max[dim_y]) {
+    return;
   }
+
+  lit = (((BITROW_ONE << (p->lit_max[dim_x] + 1)) - 1) &
+         ~((BITROW_ONE << p->lit_min[dim_x]) - 1));
+  for (y = p->lit_min[dim_y]; y <= p->lit_max[dim_y]; y++) {
+    p->visible[y] &= ~lit;
+  }
+
+  pc_empty_lit_box(p);
 }
 
 terrain_type_t pc_learned_terrain(pc *p, int16_t y, int16_t x)
@@ -242,61 +271,39 @@ terrain_type_t pc_learned_terrain(pc *p, int16_t y, int16_t x)
     io_queue_message("Invalid value to %s: %d, %d", __FUNCTION__, y, x);
   }
 
-  return p->known_terrain[y][x];
+  return (terrain_type_t) ((p->known_terrain[y][x >> 1] >>
+                            ((x & 1) << 2)) & 0xf);
 }
 
 void pc_init_known_terrain(pc *p)
 {
-  uint32_t y, x;
+  memset(p->known_terrain, ter_unknown | (ter_unknown << 4),
+         sizeof (p->known_terrain));
+  memset(p->visible, 0, sizeof (p->visible));
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      p->known_terrain[y][x] = ter_unknown;
-      p->visible[y][x] = 0;
-    }
-  }
+  pc_empty_lit_box(p);
 }
 
 void pc_observe_terrain(pc *p, dungeon_t *d)
 {
-  pair_t where;
-  int16_t y_min, y_max, x_min, x_max;
-
-  y_min = p->position[dim_y] - PC_VISUAL_RANGE;
-  if (y_min < 0) {
-    y_min = 0;
-  }
-  y_max = p->position[dim_y] + PC_VISUAL_RANGE;
-  if (y_max > DUNGEON_Y - 1) {
-    y_max = DUNGEON_Y - 1;
-  }
-  x_min = p->position[dim_x] - PC_VISUAL_RANGE;
-  if (x_min < 0) {
-    x_min = 0;
-  }
-  x_max = p->position[dim_x] + PC_VISUAL_RANGE;
-  if (x_max > DUNGEON_X - 1) {
-    x_max = DUNGEON_X - 1;
-  }
-
-  for (where[dim_y] = y_min; where[dim_y] <= y_max; where[dim_y]++) {
-    where[dim_x] = x_min;
-    can_see(d, p->position, where, 1, 1);
-    where[dim_x] = x_max;
-    can_see(d, p->position, where, 1, 1);
-  }
-  /* Take one off the x range because we alreay hit the corners above. */
-  for (where[dim_x] = x_min - 1; where[dim_x] <= x_max - 1; where[dim_x]++) {
-    where[dim_y] = y_min;
-    can_see(d, p->position, where, 1, 1);
-    where[dim_y] = y_max;
-    can_see(d, p->position, where, 1, 1);
-  }       
+  fov_cast(d, p->position, PC_VISUAL_RANGE, [p, d](int32_t y, int32_t x) {
+      pair_t where;
+
+      where[dim_y] = y;
+      where[dim_x] = x;
+      pc_learn_terrain(p, where, mapxy(x, y));
+      pc_see_object(p, objxy(x, y));
+    });
 }
 
 int32_t is_illuminated(pc *p, int16_t y, int16_t x)
 {
-  return p->visible[y][x];
+  return bitboard_test(p->visible, y, x);
+}
+
+bitrow_t pc_lit_row(pc *p, int16_t y)
+{
+  return p->visible[y];
 }
 
 void pc_see_object(character *the_pc, object *o)
@@ -455,6 +462,7 @@ object *pc::from_pile(dungeon_t *d, pair_t pos)
   if ((o = (object *) d->objmap[pos[dim_y]][pos[dim_x]])) {
     d->objmap[pos[dim_y]][pos[dim_x]] = o->get_next();
     o->set_next(0);
+    path_targets_changed(d, path_target_objects);
   }
 
   return o;
@@ -648,6 +656,7 @@ void pc::talk_wizard(dungeon_t *d, pair_t wizard)
   recalculate_speed();
   mappair(wizard) = ter_floor_room;
   hardnesspair(wizard) = 0;
+  path_cell_opened(d, wizard);
   io_display(d);
 }
 
@@ -799,6 +808,7 @@ uint32_t pc::push(dungeon_t *d, uint32_t dir)
     d->PC->position[dim_y] = p[dim_y];
     d->PC->position[dim_x] = p[dim_x];
     charpair(p) = d->PC; 
+    path_invalidate(d);
   }
 
   return 0;
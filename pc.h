@@ -6,6 +6,7 @@
 # include "dims.h"
 # include "character.h"
 # include "dungeon.h"
+# include "bitboard.h"
 
 typedef enum eq_slot {
   eq_slot_weapon,
@@ -49,8 +50,16 @@ class pc : public character {
   uint32_t drop_in(dungeon_t *d, uint32_t slot);
   uint32_t destroy_in(uint32_t slot);
   uint32_t pick_up(dungeon_t *d);
-  terrain_type_t known_terrain[DUNGEON_Y][DUNGEON_X];
-  uint8_t visible[DUNGEON_Y][DUNGEON_X];
+  /* What the PC remembers of the map, two cells to a byte (terrain     *
+   * fits in four bits), and what's lit, a bit per cell in the layout of *
+   * bitboard.h.  Go through pc_learn_terrain(), pc_learned_terrain(),   *
+   * is_illuminated() and pc_lit_row().                                  */
+  uint8_t known_terrain[DUNGEON_Y][(DUNGEON_X + 1) / 2];
+  bitrow_t visible[DUNGEON_Y];
+  /* Bounding box of the cells marked visible since the last reset, so *
+   * a reset only has to clear what was lit.  Empty when lit_min is    *
+   * past lit_max.                                                     */
+  pair_t lit_min, lit_max;
 };
 
 void pc_delete(pc *pc);
@@ -64,6 +73,8 @@ terrain_type_t pc_learned_terrain(pc *p, int16_t y, int16_t x);
 void pc_init_known_terrain(pc *p);
 void pc_observe_terrain(pc *p, dungeon *d);
 int32_t is_illuminated(pc *p, int16_t y, int16_t x);
+/* Row y of the lit cells, column x in bit x. */
+bitrow_t pc_lit_row(pc *p, int16_t y);
 void pc_reset_visibility(pc *p);
 
 #endif
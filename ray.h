@@ -0,0 +1,115 @@
+#ifndef RAY_H
+# define RAY_H
+
+# include <stdint.h>
+
+# include "dungeon.h"
+
+/* Bresenham sight lines, worked out once by the compiler.  Within the   *
+ * visual ranges, the cells on the line from a viewer to a target only   *
+ * depend on the offset between them, so every line that fits in the     *
+ * larger range is kept in a table: rays.step[dy + RAY_RANGE]            *
+ * [dx + RAY_RANGE] is the line to (dy, dx), one (y, x) offset a step,   *
+ * max(|dy|, |dx|) + 1 steps counting the viewer's own cell.  The        *
+ * constructor runs the same Bresenham can_see() used to run on every    *
+ * query, so the lines come out exactly the same, and walking one is a   *
+ * short loop with no slope tests.                                       *
+ *                                                                       *
+ * Bresenham lines don't nest: the rest of a line, from one of its cells *
+ * on, needn't be the line from that cell.  rays.join[dy + RAY_RANGE]    *
+ * [dx + RAY_RANGE] is the first step k > 0 where it is, so the line to  *
+ * (dy, dx) is its first k steps followed by the line from step k, and   *
+ * is 0 for lines with nothing between their ends.                       */
+# define RAY_RANGE (PC_VISUAL_RANGE > NPC_VISUAL_RANGE ? \
+                    PC_VISUAL_RANGE : NPC_VISUAL_RANGE)
+# define RAY_SIDE  (2 * RAY_RANGE + 1)
+
+struct ray_table {
+  int8_t step[RAY_SIDE][RAY_SIDE][RAY_RANGE + 1][2];
+  int8_t join[RAY_SIDE][RAY_SIDE];
+
+  constexpr ray_table() : step(), join()
+  {
+    for (int32_t dy = -RAY_RANGE; dy <= RAY_RANGE; dy++) {
+      for (int32_t dx = -RAY_RANGE; dx <= RAY_RANGE; dx++) {
+        trace(dy, dx);
+      }
+    }
+    for (int32_t dy = -RAY_RANGE; dy <= RAY_RANGE; dy++) {
+      for (int32_t dx = -RAY_RANGE; dx <= RAY_RANGE; dx++) {
+        find_join(dy, dx);
+      }
+    }
+  }
+
+  constexpr void find_join(int32_t dy, int32_t dx)
+  {
+    const int8_t (*line)[2] = step[dy + RAY_RANGE][dx + RAY_RANGE];
+    const int8_t (*rest)[2] = nullptr;
+    int32_t len = (dy > 0 ? dy : -dy) > (dx > 0 ? dx : -dx) ?
+                  (dy > 0 ? dy : -dy) : (dx > 0 ? dx : -dx);
+    int32_t i = 0, k = 0;
+
+    /* From the next to last cell, the line is its last step, so *
+     * every line with a cell between its ends has a join.        */
+    for (k = 1; k < len; k++) {
+      rest = step[dy - line[k][0] + RAY_RANGE][dx - line[k][1] + RAY_RANGE];
+      for (i = k; i <= len; i++) {
+        if (line[k][0] + rest[i - k][0] != line[i][0] ||
+            line[k][1] + rest[i - k][1] != line[i][1]) {
+          break;
+        }
+      }
+      if (i > len) {
+        join[dy + RAY_RANGE][dx + RAY_RANGE] = k;
+        return;
+      }
+    }
+  }
+
+  constexpr void trace(int32_t dy, int32_t dx)
+  {
+    /* constexpr functions can't leave anything uninitialized. */
+    int32_t del_y = dy > 0 ? dy : -dy;
+    int32_t f_y = dy > 0 ? 1 : -1;
+    int32_t del_x = dx > 0 ? dx : -dx;
+    int32_t f_x = dx > 0 ? 1 : -1;
+    int32_t a = 0, b = 0, c = 0, i = 0, y = 0, x = 0;
+
+    if (del_x > del_y) {
+      a = del_y + del_y;
+      c = a - del_x;
+      b = c - del_x;
+      for (i = 0; i <= del_x; i++) {
+        step[dy + RAY_RANGE][dx + RAY_RANGE][i][0] = y;
+        step[dy + RAY_RANGE][dx + RAY_RANGE][i][1] = x;
+        x += f_x;
+        if (c < 0) {
+          c += a;
+        } else {
+          c += b;
+          y += f_y;
+        }
+      }
+    } else {
+      a = del_x + del_x;
+      c = a - del_y;
+      b = c - del_y;
+      for (i = 0; i <= del_y; i++) {
+        step[dy + RAY_RANGE][dx + RAY_RANGE][i][0] = y;
+        step[dy + RAY_RANGE][dx + RAY_RANGE][i][1] = x;
+        y += f_y;
+        if (c < 0) {
+          c += a;
+        } else {
+          c += b;
+          x += f_x;
+        }
+      }
+    }
+  }
+};
+
+inline constexpr ray_table rays;
+
+#endif
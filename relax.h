@@ -0,0 +1,125 @@
+#ifndef RELAX_H
+# define RELAX_H
+
+# include <stdint.h>
+# include <utility>
+
+# include "dungeon.h"
+# include "path.h"
+
+/* The pieces every grid search in the game is built from: neighbor     *
+ * tables, hardness lookup tables, and a relaxation step that the       *
+ * compiler unrolls and specializes for each cost policy.               *
+ *                                                                      *
+ * A cost policy is a class with:                                       *
+ *   num_neighbors, neighbor    the neighborhood, from one of the       *
+ *                              tables below                            *
+ *   open(y, x)                 whether the search may enter the cell   *
+ *   cost(y, x)                 the cost of stepping out of the cell    *
+ * The Dijkstras are written once, as templates over the policy.       */
+
+typedef struct neighbor {
+  int8_t y;
+  int8_t x;
+} neighbor_t;
+
+/* Row by row, top left to bottom right. */
+constexpr neighbor_t neighbors8[8] = {
+  { -1, -1 }, { -1,  0 }, { -1,  1 },
+  {  0, -1 },             {  0,  1 },
+  {  1, -1 }, {  1,  0 }, {  1,  1 }
+};
+
+constexpr neighbor_t neighbors4[4] = {
+              { -1,  0 },
+  {  0, -1 },             {  0,  1 },
+              {  1,  0 }
+};
+
+/* The order monsters try directions when following a gradient.  Ties go *
+ * to the earlier entry, so cardinal directions are preferred.           */
+constexpr neighbor_t gradient_neighbors[8] = {
+  { -1,  0 }, {  1,  0 }, {  0,  1 }, {  0, -1 },
+  { -1,  1 }, {  1,  1 }, { -1, -1 }, {  1, -1 }
+};
+
+/* hardness / divisor + base for every possible hardness, so searches *
+ * look costs up instead of dividing on every edge.                   */
+struct hardness_lut {
+  uint8_t cost[256];
+  constexpr hardness_lut(uint32_t divisor, uint32_t base) : cost()
+  {
+    for (uint32_t h = 0; h < 256; h++) {
+      cost[h] = h / divisor + base;
+    }
+  }
+};
+
+/* Turns to tunnel out of a cell.  Ignores the case of hardness == 255, *
+ * because if that gets here, there's already been an error.            */
+constexpr hardness_lut tunnel_cost_lut(HARDNESS_PER_TURN, 1);
+
+template <class Policy, class F, std::size_t... I>
+inline void for_each_neighbor_unrolled(uint32_t y, uint32_t x, F &f,
+                                       std::index_sequence<I...>)
+{
+  (f(y + Policy::neighbor[I].y, x + Policy::neighbor[I].x), ...);
+}
+
+/* Calls f(y, x) on each of Policy's neighbors of (y, x), in table order. */
+template <class Policy, class F>
+inline void for_each_neighbor(uint32_t y, uint32_t x, F f)
+{
+  for_each_neighbor_unrolled<Policy>(y, x, f,
+                                     std::make_index_sequence<
+                                       Policy::num_neighbors>());
+}
+
+/* One Dijkstra step out of (y, x).  Search holds the distances and the *
+ * queue: queued(y, x) says whether a cell is still in the queue,       *
+ * dist(y, x) is its tentative distance, and improve(y, x, dist, from_y,*
+ * from_x) lowers it.                                                   */
+template <class Policy, class Search>
+inline void relax(const Policy &policy, Search &s, uint32_t y, uint32_t x)
+{
+  int32_t nd;
+
+  nd = s.dist(y, x) + policy.cost(y, x);
+  for_each_neighbor<Policy>(y, x, [&](uint32_t ny, uint32_t nx) {
+    if (s.queued(ny, nx) && s.dist(ny, nx) > nd) {
+      s.improve(ny, nx, nd, y, x);
+    }
+  });
+}
+
+/* The two policies for the PC distance maps.  The corridor policies *
+ * live with the corridor code in dungeon.cpp.                       */
+struct walk_policy {
+  static constexpr uint32_t num_neighbors = 8;
+  static constexpr const neighbor_t *neighbor = neighbors8;
+  const dungeon_t *d;
+  inline bool open(uint32_t y, uint32_t x) const
+  {
+    return d->map[y][x] >= ter_floor;
+  }
+  inline int32_t cost(uint32_t, uint32_t) const
+  {
+    return 1;
+  }
+};
+
+struct tunnel_policy {
+  static constexpr uint32_t num_neighbors = 8;
+  static constexpr const neighbor_t *neighbor = neighbors8;
+  const dungeon_t *d;
+  inline bool open(uint32_t y, uint32_t x) const
+  {
+    return d->map[y][x] != ter_wall_immutable;
+  }
+  inline int32_t cost(uint32_t y, uint32_t x) const
+  {
+    return tunnel_cost_lut.cost[d->hardness[y][x]];
+  }
+};
+
+#endif
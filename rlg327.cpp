@@ -10,6 +10,7 @@
 #include "io.h"
 #include "descriptions.h"
 #include "object.h"
+#include "path.h"
 
 const char *victory =
   "\n                                       o\n"
@@ -69,7 +70,8 @@ void usage(char *name)
           "Usage: %s [-r|--rand <seed>] [-l|--load [<file>]]\n"
           "          [-s|--save [<file>]] [-i|--image <pgm file>]\n"
           "          [-p|--pc <y> <x>] [-n|--nummon <count>]\n"
-          "          [-o|--objcount <oject count>]\n",
+          "          [-o|--objcount <oject count>]\n"
+          "          [-e|--engine <heap|bucket|sweep>]\n",
           name);
 
   exit(-1);
@@ -208,6 +210,22 @@ int main(int argc, char *argv[])
             usage(argv[0]);
           }
           break;
+        case 'e':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-engine")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          if (!strcmp(argv[i], "heap")) {
+            path_set_engine(path_engine_heap);
+          } else if (!strcmp(argv[i], "bucket")) {
+            path_set_engine(path_engine_bucket);
+          } else if (!strcmp(argv[i], "sweep")) {
+            path_set_engine(path_engine_sweep);
+          } else {
+            usage(argv[0]);
+          }
+          break;
          default:
           usage(argv[0]);
         }
@@ -292,6 +310,7 @@ int main(int argc, char *argv[])
   }
 
   delete_dungeon(&d);
+  los_cache_delete(d.los);
   destroy_descriptions(&d);
 
   return 0;